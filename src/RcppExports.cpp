@@ -7,69 +7,70 @@
 using namespace Rcpp;
 
 // em_with_zero_mean_c
-arma::mat em_with_zero_mean_c(arma::mat y, int maxit);
-RcppExport SEXP _MCMCArmadillo_em_with_zero_mean_c(SEXP ySEXP, SEXP maxitSEXP) {
+arma::mat em_with_zero_mean_c(const arma::mat& y, int maxit, bool single);
+RcppExport SEXP _MCMCArmadillo_em_with_zero_mean_c(SEXP ySEXP, SEXP maxitSEXP, SEXP singleSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::mat >::type y(ySEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type y(ySEXP);
     Rcpp::traits::input_parameter< int >::type maxit(maxitSEXP);
-    rcpp_result_gen = Rcpp::wrap(em_with_zero_mean_c(y, maxit));
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    rcpp_result_gen = Rcpp::wrap(em_with_zero_mean_c(y, maxit, single));
     return rcpp_result_gen;
 END_RCPP
 }
 // mvrnormArma
-arma::mat mvrnormArma(int n, arma::vec mu, arma::mat Sigma);
+arma::mat mvrnormArma(int n, const arma::vec& mu, const arma::mat& Sigma);
 RcppExport SEXP _MCMCArmadillo_mvrnormArma(SEXP nSEXP, SEXP muSEXP, SEXP SigmaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< int >::type n(nSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type mu(muSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Sigma(SigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type mu(muSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sigma(SigmaSEXP);
     rcpp_result_gen = Rcpp::wrap(mvrnormArma(n, mu, Sigma));
     return rcpp_result_gen;
 END_RCPP
 }
 // dmvnrm_arma
-double dmvnrm_arma(arma::rowvec x, arma::rowvec mean, arma::mat sigma, bool logd);
+double dmvnrm_arma(const arma::rowvec& x, const arma::rowvec& mean, const arma::mat& sigma, bool logd);
 RcppExport SEXP _MCMCArmadillo_dmvnrm_arma(SEXP xSEXP, SEXP meanSEXP, SEXP sigmaSEXP, SEXP logdSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::rowvec >::type x(xSEXP);
-    Rcpp::traits::input_parameter< arma::rowvec >::type mean(meanSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type sigma(sigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::rowvec& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< const arma::rowvec& >::type mean(meanSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type sigma(sigmaSEXP);
     Rcpp::traits::input_parameter< bool >::type logd(logdSEXP);
     rcpp_result_gen = Rcpp::wrap(dmvnrm_arma(x, mean, sigma, logd));
     return rcpp_result_gen;
 END_RCPP
 }
 // get_sigmabeta_from_h_c
-double get_sigmabeta_from_h_c(double h, arma::vec gam, arma::mat Sigma, arma::vec X, int T);
+double get_sigmabeta_from_h_c(double h, const arma::vec& gam, const arma::mat& Sigma, const arma::vec& X, int T);
 RcppExport SEXP _MCMCArmadillo_get_sigmabeta_from_h_c(SEXP hSEXP, SEXP gamSEXP, SEXP SigmaSEXP, SEXP XSEXP, SEXP TSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< double >::type h(hSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam(gamSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Sigma(SigmaSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam(gamSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sigma(SigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
     Rcpp::traits::input_parameter< int >::type T(TSEXP);
     rcpp_result_gen = Rcpp::wrap(get_sigmabeta_from_h_c(h, gam, Sigma, X, T));
     return rcpp_result_gen;
 END_RCPP
 }
 // get_h_from_sigmabeta_c
-double get_h_from_sigmabeta_c(arma::vec X, double sigmabeta, arma::mat Sigma, arma::vec gam, int n, int T);
+double get_h_from_sigmabeta_c(const arma::vec& X, double sigmabeta, const arma::mat& Sigma, const arma::vec& gam, int n, int T);
 RcppExport SEXP _MCMCArmadillo_get_h_from_sigmabeta_c(SEXP XSEXP, SEXP sigmabetaSEXP, SEXP SigmaSEXP, SEXP gamSEXP, SEXP nSEXP, SEXP TSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
     Rcpp::traits::input_parameter< double >::type sigmabeta(sigmabetaSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Sigma(SigmaSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam(gamSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sigma(SigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam(gamSEXP);
     Rcpp::traits::input_parameter< int >::type n(nSEXP);
     Rcpp::traits::input_parameter< int >::type T(TSEXP);
     rcpp_result_gen = Rcpp::wrap(get_h_from_sigmabeta_c(X, sigmabeta, Sigma, gam, n, T));
@@ -77,18 +78,20 @@ BEGIN_RCPP
 END_RCPP
 }
 // get_target_c
-arma::vec get_target_c(arma::vec X, arma::mat Y, double sigmabeta, arma::mat Sigma, arma::vec gam, arma::vec beta);
-RcppExport SEXP _MCMCArmadillo_get_target_c(SEXP XSEXP, SEXP YSEXP, SEXP sigmabetaSEXP, SEXP SigmaSEXP, SEXP gamSEXP, SEXP betaSEXP) {
+arma::vec get_target_c(const arma::vec& X, const arma::mat& Y, double sigmabeta, const arma::mat& Sigma, const arma::vec& gam, const arma::vec& beta, bool single, std::string kernel);
+RcppExport SEXP _MCMCArmadillo_get_target_c(SEXP XSEXP, SEXP YSEXP, SEXP sigmabetaSEXP, SEXP SigmaSEXP, SEXP gamSEXP, SEXP betaSEXP, SEXP singleSEXP, SEXP kernelSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
     Rcpp::traits::input_parameter< double >::type sigmabeta(sigmabetaSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Sigma(SigmaSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam(gamSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta(betaSEXP);
-    rcpp_result_gen = Rcpp::wrap(get_target_c(X, Y, sigmabeta, Sigma, gam, beta));
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sigma(SigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam(gamSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta(betaSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    Rcpp::traits::input_parameter< std::string >::type kernel(kernelSEXP);
+    rcpp_result_gen = Rcpp::wrap(get_target_c(X, Y, sigmabeta, Sigma, gam, beta, single, kernel));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -104,34 +107,49 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// simulate_data_c
+Rcpp::List simulate_data_c(int n, int T, double missing, double sparsity, double sigmabeta);
+RcppExport SEXP _MCMCArmadillo_simulate_data_c(SEXP nSEXP, SEXP TSEXP, SEXP missingSEXP, SEXP sparsitySEXP, SEXP sigmabetaSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type n(nSEXP);
+    Rcpp::traits::input_parameter< int >::type T(TSEXP);
+    Rcpp::traits::input_parameter< double >::type missing(missingSEXP);
+    Rcpp::traits::input_parameter< double >::type sparsity(sparsitySEXP);
+    Rcpp::traits::input_parameter< double >::type sigmabeta(sigmabetaSEXP);
+    rcpp_result_gen = Rcpp::wrap(simulate_data_c(n, T, missing, sparsity, sigmabeta));
+    return rcpp_result_gen;
+END_RCPP
+}
 // update_gamma_c
-Rcpp::List update_gamma_c(arma::vec X, arma::mat Y, arma::vec gam);
+Rcpp::List update_gamma_c(const arma::vec& X, const arma::mat& Y, const arma::vec& gam);
 RcppExport SEXP _MCMCArmadillo_update_gamma_c(SEXP XSEXP, SEXP YSEXP, SEXP gamSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam(gamSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam(gamSEXP);
     rcpp_result_gen = Rcpp::wrap(update_gamma_c(X, Y, gam));
     return rcpp_result_gen;
 END_RCPP
 }
 // betagam_accept_c
-arma::vec betagam_accept_c(arma::vec X, arma::mat Y, double sigmabeta1, arma::mat inputSigma, double Vbeta, arma::vec gam1, arma::vec beta1, arma::vec gam2, arma::vec beta2, int changeind, int change);
+arma::vec betagam_accept_c(const arma::vec& X, const arma::mat& Y, double sigmabeta1, const arma::mat& inputSigma, double Vbeta, const arma::vec& gam1, const arma::vec& beta1, const arma::vec& gam2, const arma::vec& beta2, int changeind, int change);
 RcppExport SEXP _MCMCArmadillo_betagam_accept_c(SEXP XSEXP, SEXP YSEXP, SEXP sigmabeta1SEXP, SEXP inputSigmaSEXP, SEXP VbetaSEXP, SEXP gam1SEXP, SEXP beta1SEXP, SEXP gam2SEXP, SEXP beta2SEXP, SEXP changeindSEXP, SEXP changeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
     Rcpp::traits::input_parameter< double >::type sigmabeta1(sigmabeta1SEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type inputSigma(inputSigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type inputSigma(inputSigmaSEXP);
     Rcpp::traits::input_parameter< double >::type Vbeta(VbetaSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam1(gam1SEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta1(beta1SEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam2(gam2SEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta2(beta2SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam1(gam1SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta1(beta1SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam2(gam2SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta2(beta2SEXP);
     Rcpp::traits::input_parameter< int >::type changeind(changeindSEXP);
     Rcpp::traits::input_parameter< int >::type change(changeSEXP);
     rcpp_result_gen = Rcpp::wrap(betagam_accept_c(X, Y, sigmabeta1, inputSigma, Vbeta, gam1, beta1, gam2, beta2, changeind, change));
@@ -139,16 +157,16 @@ BEGIN_RCPP
 END_RCPP
 }
 // update_betagam_c
-Rcpp::List update_betagam_c(arma::vec X, arma::mat Y, arma::vec gam1, arma::vec beta1, arma::mat Sigma, double sigmabeta, double Vbeta, int bgiter);
+Rcpp::List update_betagam_c(const arma::vec& X, const arma::mat& Y, const arma::vec& gam1, const arma::vec& beta1, const arma::mat& Sigma, double sigmabeta, double Vbeta, int bgiter);
 RcppExport SEXP _MCMCArmadillo_update_betagam_c(SEXP XSEXP, SEXP YSEXP, SEXP gam1SEXP, SEXP beta1SEXP, SEXP SigmaSEXP, SEXP sigmabetaSEXP, SEXP VbetaSEXP, SEXP bgiterSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam1(gam1SEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta1(beta1SEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Sigma(SigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam1(gam1SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta1(beta1SEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sigma(SigmaSEXP);
     Rcpp::traits::input_parameter< double >::type sigmabeta(sigmabetaSEXP);
     Rcpp::traits::input_parameter< double >::type Vbeta(VbetaSEXP);
     Rcpp::traits::input_parameter< int >::type bgiter(bgiterSEXP);
@@ -157,80 +175,80 @@ BEGIN_RCPP
 END_RCPP
 }
 // update_h_c
-Rcpp::List update_h_c(double initialh, int hiter, arma::vec gam, arma::vec beta, arma::mat Sig, arma::vec X, int T);
+Rcpp::List update_h_c(double initialh, int hiter, const arma::vec& gam, const arma::vec& beta, const arma::mat& Sig, const arma::vec& X, int T);
 RcppExport SEXP _MCMCArmadillo_update_h_c(SEXP initialhSEXP, SEXP hiterSEXP, SEXP gamSEXP, SEXP betaSEXP, SEXP SigSEXP, SEXP XSEXP, SEXP TSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< double >::type initialh(initialhSEXP);
     Rcpp::traits::input_parameter< int >::type hiter(hiterSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam(gamSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta(betaSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Sig(SigSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam(gamSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta(betaSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sig(SigSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
     Rcpp::traits::input_parameter< int >::type T(TSEXP);
     rcpp_result_gen = Rcpp::wrap(update_h_c(initialh, hiter, gam, beta, Sig, X, T));
     return rcpp_result_gen;
 END_RCPP
 }
 // rinvwish_c
-arma::cube rinvwish_c(int n, int v, arma::mat S);
+arma::cube rinvwish_c(int n, int v, const arma::mat& S);
 RcppExport SEXP _MCMCArmadillo_rinvwish_c(SEXP nSEXP, SEXP vSEXP, SEXP SSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< int >::type n(nSEXP);
     Rcpp::traits::input_parameter< int >::type v(vSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type S(SSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type S(SSEXP);
     rcpp_result_gen = Rcpp::wrap(rinvwish_c(n, v, S));
     return rcpp_result_gen;
 END_RCPP
 }
 // update_Sigma_c
-arma::mat update_Sigma_c(int n, int nu, arma::vec X, arma::vec beta, arma::mat Phi, arma::mat Y);
+arma::mat update_Sigma_c(int n, int nu, const arma::vec& X, const arma::vec& beta, const arma::mat& Phi, const arma::mat& Y);
 RcppExport SEXP _MCMCArmadillo_update_Sigma_c(SEXP nSEXP, SEXP nuSEXP, SEXP XSEXP, SEXP betaSEXP, SEXP PhiSEXP, SEXP YSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< int >::type n(nSEXP);
     Rcpp::traits::input_parameter< int >::type nu(nuSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta(betaSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Phi(PhiSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta(betaSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Phi(PhiSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
     rcpp_result_gen = Rcpp::wrap(update_Sigma_c(n, nu, X, beta, Phi, Y));
     return rcpp_result_gen;
 END_RCPP
 }
 // update_gamma_sw_c
-Rcpp::List update_gamma_sw_c(arma::vec X, arma::mat Y, arma::vec gam, arma::rowvec marcor);
+Rcpp::List update_gamma_sw_c(const arma::vec& X, const arma::mat& Y, const arma::vec& gam, const arma::rowvec& marcor);
 RcppExport SEXP _MCMCArmadillo_update_gamma_sw_c(SEXP XSEXP, SEXP YSEXP, SEXP gamSEXP, SEXP marcorSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam(gamSEXP);
-    Rcpp::traits::input_parameter< arma::rowvec >::type marcor(marcorSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam(gamSEXP);
+    Rcpp::traits::input_parameter< const arma::rowvec& >::type marcor(marcorSEXP);
     rcpp_result_gen = Rcpp::wrap(update_gamma_sw_c(X, Y, gam, marcor));
     return rcpp_result_gen;
 END_RCPP
 }
 // betagam_accept_sw_c
-arma::vec betagam_accept_sw_c(arma::vec X, arma::mat Y, double sigmabeta1, arma::mat inputSigma, double Vbeta, arma::vec gam1, arma::vec beta1, arma::vec gam2, arma::vec beta2, int changeind, int change);
+arma::vec betagam_accept_sw_c(const arma::vec& X, const arma::mat& Y, double sigmabeta1, const arma::mat& inputSigma, double Vbeta, const arma::vec& gam1, const arma::vec& beta1, const arma::vec& gam2, const arma::vec& beta2, int changeind, int change);
 RcppExport SEXP _MCMCArmadillo_betagam_accept_sw_c(SEXP XSEXP, SEXP YSEXP, SEXP sigmabeta1SEXP, SEXP inputSigmaSEXP, SEXP VbetaSEXP, SEXP gam1SEXP, SEXP beta1SEXP, SEXP gam2SEXP, SEXP beta2SEXP, SEXP changeindSEXP, SEXP changeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
     Rcpp::traits::input_parameter< double >::type sigmabeta1(sigmabeta1SEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type inputSigma(inputSigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type inputSigma(inputSigmaSEXP);
     Rcpp::traits::input_parameter< double >::type Vbeta(VbetaSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam1(gam1SEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta1(beta1SEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam2(gam2SEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta2(beta2SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam1(gam1SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta1(beta1SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam2(gam2SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta2(beta2SEXP);
     Rcpp::traits::input_parameter< int >::type changeind(changeindSEXP);
     Rcpp::traits::input_parameter< int >::type change(changeSEXP);
     rcpp_result_gen = Rcpp::wrap(betagam_accept_sw_c(X, Y, sigmabeta1, inputSigma, Vbeta, gam1, beta1, gam2, beta2, changeind, change));
@@ -238,17 +256,17 @@ BEGIN_RCPP
 END_RCPP
 }
 // update_betagam_sw_c
-Rcpp::List update_betagam_sw_c(arma::vec X, arma::mat Y, arma::vec gam1, arma::vec beta1, arma::mat Sigma, arma::rowvec marcor, double sigmabeta, double Vbeta, int bgiter, int smallworlditer);
+Rcpp::List update_betagam_sw_c(const arma::vec& X, const arma::mat& Y, const arma::vec& gam1, const arma::vec& beta1, const arma::mat& Sigma, const arma::rowvec& marcor, double sigmabeta, double Vbeta, int bgiter, int smallworlditer);
 RcppExport SEXP _MCMCArmadillo_update_betagam_sw_c(SEXP XSEXP, SEXP YSEXP, SEXP gam1SEXP, SEXP beta1SEXP, SEXP SigmaSEXP, SEXP marcorSEXP, SEXP sigmabetaSEXP, SEXP VbetaSEXP, SEXP bgiterSEXP, SEXP smallworlditerSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type gam1(gam1SEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type beta1(beta1SEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Sigma(SigmaSEXP);
-    Rcpp::traits::input_parameter< arma::rowvec >::type marcor(marcorSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam1(gam1SEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta1(beta1SEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sigma(SigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::rowvec& >::type marcor(marcorSEXP);
     Rcpp::traits::input_parameter< double >::type sigmabeta(sigmabetaSEXP);
     Rcpp::traits::input_parameter< double >::type Vbeta(VbetaSEXP);
     Rcpp::traits::input_parameter< int >::type bgiter(bgiterSEXP);
@@ -257,61 +275,129 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// beta_quadratic_c
+Rcpp::List beta_quadratic_c(const arma::vec& X, const arma::mat& Y, const arma::mat& Sigma);
+RcppExport SEXP _MCMCArmadillo_beta_quadratic_c(SEXP XSEXP, SEXP YSEXP, SEXP SigmaSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sigma(SigmaSEXP);
+    rcpp_result_gen = Rcpp::wrap(beta_quadratic_c(X, Y, Sigma));
+    return rcpp_result_gen;
+END_RCPP
+}
+// update_beta_mala_c
+arma::vec update_beta_mala_c(const arma::vec& X, const arma::mat& Y, const arma::mat& Sigma, double sigmabeta, const arma::vec& gam, const arma::vec& beta, int niter, double eps);
+RcppExport SEXP _MCMCArmadillo_update_beta_mala_c(SEXP XSEXP, SEXP YSEXP, SEXP SigmaSEXP, SEXP sigmabetaSEXP, SEXP gamSEXP, SEXP betaSEXP, SEXP niterSEXP, SEXP epsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Sigma(SigmaSEXP);
+    Rcpp::traits::input_parameter< double >::type sigmabeta(sigmabetaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type gam(gamSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type beta(betaSEXP);
+    Rcpp::traits::input_parameter< int >::type niter(niterSEXP);
+    Rcpp::traits::input_parameter< double >::type eps(epsSEXP);
+    rcpp_result_gen = Rcpp::wrap(update_beta_mala_c(X, Y, Sigma, sigmabeta, gam, beta, niter, eps));
+    return rcpp_result_gen;
+END_RCPP
+}
 // doMCMC_c
-Rcpp::List doMCMC_c(arma::vec X, arma::mat Y, int n, int T, arma::mat Phi, int nu, arma::vec initialbeta, arma::vec initialgamma, arma::mat initialSigma, double initialsigmabeta, arma::rowvec marcor, double Vbeta, int niter, int bgiter, int hiter, int switer);
-RcppExport SEXP _MCMCArmadillo_doMCMC_c(SEXP XSEXP, SEXP YSEXP, SEXP nSEXP, SEXP TSEXP, SEXP PhiSEXP, SEXP nuSEXP, SEXP initialbetaSEXP, SEXP initialgammaSEXP, SEXP initialSigmaSEXP, SEXP initialsigmabetaSEXP, SEXP marcorSEXP, SEXP VbetaSEXP, SEXP niterSEXP, SEXP bgiterSEXP, SEXP hiterSEXP, SEXP switerSEXP) {
+Rcpp::List doMCMC_c(const arma::vec& X, const arma::mat& Y, int n, int T, const arma::mat& Phi, int nu, const arma::vec& initialbeta, const arma::vec& initialgamma, const arma::mat& initialSigma, double initialsigmabeta, const arma::rowvec& marcor, double Vbeta, int niter, int bgiter, int hiter, int switer, Rcpp::Nullable<Rcpp::NumericMatrix> covariates);
+RcppExport SEXP _MCMCArmadillo_doMCMC_c(SEXP XSEXP, SEXP YSEXP, SEXP nSEXP, SEXP TSEXP, SEXP PhiSEXP, SEXP nuSEXP, SEXP initialbetaSEXP, SEXP initialgammaSEXP, SEXP initialSigmaSEXP, SEXP initialsigmabetaSEXP, SEXP marcorSEXP, SEXP VbetaSEXP, SEXP niterSEXP, SEXP bgiterSEXP, SEXP hiterSEXP, SEXP switerSEXP, SEXP covariatesSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
     Rcpp::traits::input_parameter< int >::type n(nSEXP);
     Rcpp::traits::input_parameter< int >::type T(TSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Phi(PhiSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Phi(PhiSEXP);
     Rcpp::traits::input_parameter< int >::type nu(nuSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type initialbeta(initialbetaSEXP);
-    Rcpp::traits::input_parameter< arma::vec >::type initialgamma(initialgammaSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type initialSigma(initialSigmaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type initialbeta(initialbetaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type initialgamma(initialgammaSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type initialSigma(initialSigmaSEXP);
     Rcpp::traits::input_parameter< double >::type initialsigmabeta(initialsigmabetaSEXP);
-    Rcpp::traits::input_parameter< arma::rowvec >::type marcor(marcorSEXP);
+    Rcpp::traits::input_parameter< const arma::rowvec& >::type marcor(marcorSEXP);
     Rcpp::traits::input_parameter< double >::type Vbeta(VbetaSEXP);
     Rcpp::traits::input_parameter< int >::type niter(niterSEXP);
     Rcpp::traits::input_parameter< int >::type bgiter(bgiterSEXP);
     Rcpp::traits::input_parameter< int >::type hiter(hiterSEXP);
     Rcpp::traits::input_parameter< int >::type switer(switerSEXP);
-    rcpp_result_gen = Rcpp::wrap(doMCMC_c(X, Y, n, T, Phi, nu, initialbeta, initialgamma, initialSigma, initialsigmabeta, marcor, Vbeta, niter, bgiter, hiter, switer));
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericMatrix> >::type covariates(covariatesSEXP);
+    rcpp_result_gen = Rcpp::wrap(doMCMC_c(X, Y, n, T, Phi, nu, initialbeta, initialgamma, initialSigma, initialsigmabeta, marcor, Vbeta, niter, bgiter, hiter, switer, covariates));
     return rcpp_result_gen;
 END_RCPP
 }
 // run2chains_c
-Rcpp::List run2chains_c(arma::vec X, arma::mat Y, Rcpp::List initial_chain1, Rcpp::List initial_chain2, arma::mat Phi, int niter, int bgiter, int hiter, int switer, int burnin);
-RcppExport SEXP _MCMCArmadillo_run2chains_c(SEXP XSEXP, SEXP YSEXP, SEXP initial_chain1SEXP, SEXP initial_chain2SEXP, SEXP PhiSEXP, SEXP niterSEXP, SEXP bgiterSEXP, SEXP hiterSEXP, SEXP switerSEXP, SEXP burninSEXP) {
+Rcpp::List run2chains_c(const arma::vec& X, const arma::mat& Y, Rcpp::List initial_chain1, Rcpp::List initial_chain2, const arma::mat& Phi, int niter, int bgiter, int hiter, int switer, int burnin, int ntemps, double maxtemp, int swapiter, bool adapt, int malaiter, bool single, int nfactors, Rcpp::Nullable<Rcpp::NumericMatrix> covariates, int models, bool delayed, double swapprob, std::string kernel, bool tune, double screen);
+RcppExport SEXP _MCMCArmadillo_run2chains_c(SEXP XSEXP, SEXP YSEXP, SEXP initial_chain1SEXP, SEXP initial_chain2SEXP, SEXP PhiSEXP, SEXP niterSEXP, SEXP bgiterSEXP, SEXP hiterSEXP, SEXP switerSEXP, SEXP burninSEXP, SEXP ntempsSEXP, SEXP maxtempSEXP, SEXP swapiterSEXP, SEXP adaptSEXP, SEXP malaiterSEXP, SEXP singleSEXP, SEXP nfactorsSEXP, SEXP covariatesSEXP, SEXP modelsSEXP, SEXP delayedSEXP, SEXP swapprobSEXP, SEXP kernelSEXP, SEXP tuneSEXP, SEXP screenSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< arma::vec >::type X(XSEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
     Rcpp::traits::input_parameter< Rcpp::List >::type initial_chain1(initial_chain1SEXP);
     Rcpp::traits::input_parameter< Rcpp::List >::type initial_chain2(initial_chain2SEXP);
-    Rcpp::traits::input_parameter< arma::mat >::type Phi(PhiSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Phi(PhiSEXP);
     Rcpp::traits::input_parameter< int >::type niter(niterSEXP);
     Rcpp::traits::input_parameter< int >::type bgiter(bgiterSEXP);
     Rcpp::traits::input_parameter< int >::type hiter(hiterSEXP);
     Rcpp::traits::input_parameter< int >::type switer(switerSEXP);
     Rcpp::traits::input_parameter< int >::type burnin(burninSEXP);
-    rcpp_result_gen = Rcpp::wrap(run2chains_c(X, Y, initial_chain1, initial_chain2, Phi, niter, bgiter, hiter, switer, burnin));
+    Rcpp::traits::input_parameter< int >::type ntemps(ntempsSEXP);
+    Rcpp::traits::input_parameter< double >::type maxtemp(maxtempSEXP);
+    Rcpp::traits::input_parameter< int >::type swapiter(swapiterSEXP);
+    Rcpp::traits::input_parameter< bool >::type adapt(adaptSEXP);
+    Rcpp::traits::input_parameter< int >::type malaiter(malaiterSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    Rcpp::traits::input_parameter< int >::type nfactors(nfactorsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::Nullable<Rcpp::NumericMatrix> >::type covariates(covariatesSEXP);
+    Rcpp::traits::input_parameter< int >::type models(modelsSEXP);
+    Rcpp::traits::input_parameter< bool >::type delayed(delayedSEXP);
+    Rcpp::traits::input_parameter< double >::type swapprob(swapprobSEXP);
+    Rcpp::traits::input_parameter< std::string >::type kernel(kernelSEXP);
+    Rcpp::traits::input_parameter< bool >::type tune(tuneSEXP);
+    Rcpp::traits::input_parameter< double >::type screen(screenSEXP);
+    rcpp_result_gen = Rcpp::wrap(run2chains_c(X, Y, initial_chain1, initial_chain2, Phi, niter, bgiter, hiter, switer, burnin, ntemps, maxtemp, swapiter, adapt, malaiter, single, nfactors, covariates, models, delayed, swapprob, kernel, tune, screen));
+    return rcpp_result_gen;
+END_RCPP
+}
+// run_batch_c
+Rcpp::List run_batch_c(const arma::mat& X, const arma::mat& Y, const arma::mat& Phi, int nchains, int niter, int bgiter, int hiter, int switer, int burnin, double sigmabeta, bool single);
+RcppExport SEXP _MCMCArmadillo_run_batch_c(SEXP XSEXP, SEXP YSEXP, SEXP PhiSEXP, SEXP nchainsSEXP, SEXP niterSEXP, SEXP bgiterSEXP, SEXP hiterSEXP, SEXP switerSEXP, SEXP burninSEXP, SEXP sigmabetaSEXP, SEXP singleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type X(XSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Y(YSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type Phi(PhiSEXP);
+    Rcpp::traits::input_parameter< int >::type nchains(nchainsSEXP);
+    Rcpp::traits::input_parameter< int >::type niter(niterSEXP);
+    Rcpp::traits::input_parameter< int >::type bgiter(bgiterSEXP);
+    Rcpp::traits::input_parameter< int >::type hiter(hiterSEXP);
+    Rcpp::traits::input_parameter< int >::type switer(switerSEXP);
+    Rcpp::traits::input_parameter< int >::type burnin(burninSEXP);
+    Rcpp::traits::input_parameter< double >::type sigmabeta(sigmabetaSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    rcpp_result_gen = Rcpp::wrap(run_batch_c(X, Y, Phi, nchains, niter, bgiter, hiter, switer, burnin, sigmabeta, single));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_MCMCArmadillo_em_with_zero_mean_c", (DL_FUNC) &_MCMCArmadillo_em_with_zero_mean_c, 2},
+    {"_MCMCArmadillo_em_with_zero_mean_c", (DL_FUNC) &_MCMCArmadillo_em_with_zero_mean_c, 3},
     {"_MCMCArmadillo_mvrnormArma", (DL_FUNC) &_MCMCArmadillo_mvrnormArma, 3},
     {"_MCMCArmadillo_dmvnrm_arma", (DL_FUNC) &_MCMCArmadillo_dmvnrm_arma, 4},
     {"_MCMCArmadillo_get_sigmabeta_from_h_c", (DL_FUNC) &_MCMCArmadillo_get_sigmabeta_from_h_c, 5},
     {"_MCMCArmadillo_get_h_from_sigmabeta_c", (DL_FUNC) &_MCMCArmadillo_get_h_from_sigmabeta_c, 6},
-    {"_MCMCArmadillo_get_target_c", (DL_FUNC) &_MCMCArmadillo_get_target_c, 6},
+    {"_MCMCArmadillo_get_target_c", (DL_FUNC) &_MCMCArmadillo_get_target_c, 8},
     {"_MCMCArmadillo_sample_index", (DL_FUNC) &_MCMCArmadillo_sample_index, 2},
+    {"_MCMCArmadillo_simulate_data_c", (DL_FUNC) &_MCMCArmadillo_simulate_data_c, 5},
     {"_MCMCArmadillo_update_gamma_c", (DL_FUNC) &_MCMCArmadillo_update_gamma_c, 3},
     {"_MCMCArmadillo_betagam_accept_c", (DL_FUNC) &_MCMCArmadillo_betagam_accept_c, 11},
     {"_MCMCArmadillo_update_betagam_c", (DL_FUNC) &_MCMCArmadillo_update_betagam_c, 8},
@@ -321,8 +407,11 @@ static const R_CallMethodDef CallEntries[] = {
     {"_MCMCArmadillo_update_gamma_sw_c", (DL_FUNC) &_MCMCArmadillo_update_gamma_sw_c, 4},
     {"_MCMCArmadillo_betagam_accept_sw_c", (DL_FUNC) &_MCMCArmadillo_betagam_accept_sw_c, 11},
     {"_MCMCArmadillo_update_betagam_sw_c", (DL_FUNC) &_MCMCArmadillo_update_betagam_sw_c, 10},
-    {"_MCMCArmadillo_doMCMC_c", (DL_FUNC) &_MCMCArmadillo_doMCMC_c, 16},
-    {"_MCMCArmadillo_run2chains_c", (DL_FUNC) &_MCMCArmadillo_run2chains_c, 10},
+    {"_MCMCArmadillo_beta_quadratic_c", (DL_FUNC) &_MCMCArmadillo_beta_quadratic_c, 3},
+    {"_MCMCArmadillo_update_beta_mala_c", (DL_FUNC) &_MCMCArmadillo_update_beta_mala_c, 8},
+    {"_MCMCArmadillo_doMCMC_c", (DL_FUNC) &_MCMCArmadillo_doMCMC_c, 17},
+    {"_MCMCArmadillo_run2chains_c", (DL_FUNC) &_MCMCArmadillo_run2chains_c, 24},
+    {"_MCMCArmadillo_run_batch_c", (DL_FUNC) &_MCMCArmadillo_run_batch_c, 11},
     {NULL, NULL, 0}
 };
 
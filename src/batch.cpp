@@ -0,0 +1,266 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// lockstep batches of chains (ChainBatch). For small T a single chain's
+// inner step is a handful of scalar operations on T-vectors, too short to
+// fill the vector units; B chains stored chain-major turn the same
+// arithmetic into loops of length B.
+#include "mcmc_core.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace mcmc {
+
+static void set_likelihood(ChainBatch& cb, int b){
+  //chain b's closed form and Sigma diagonal, from its current Sigma
+  BetaQuadratic q;
+  cb.c(b) = likelihood_quadratic(cb.data[b]->patterns, cb.Sigma[b], q);
+  int T = q.g.n_elem;
+  for (int j=0; j<T; ++j){
+    cb.g(b,j) = q.g(j);
+    cb.sigdiag(b,j) = cb.Sigma[b](j,j);
+    cb.logsigdiag(b,j) = std::log(cb.Sigma[b](j,j));
+    for (int i=0; i<T; ++i){cb.H(b,i,j) = q.H(i,j);}
+  }
+}
+
+static void batch_target(const ChainBatch& cb, const arma::mat& gam,
+                         const arma::mat& beta, arma::mat& parts){
+  //parts.row(b) = (log likelihood, beta prior, gamma prior) of row b of
+  //(gam, beta), as target_parts(); every inner loop runs over the chains
+  int B = gam.n_rows, T = gam.n_cols;
+  parts.zeros(B, 3);
+  double* L = parts.colptr(0);
+  double* P = parts.colptr(1);
+  double* G = parts.colptr(2);
+  for (int b=0; b<B; ++b){L[b] = cb.c(b);}
+  for (int j=0; j<T; ++j){
+    //G holds (H beta)_j until the gamma prior
+    for (int b=0; b<B; ++b){G[b] = 0;}
+    const arma::mat& Hj = cb.H.slice(j);
+    for (int i=0; i<T; ++i){
+      const double* h = Hj.colptr(i);
+      const double* bi = beta.colptr(i);
+      for (int b=0; b<B; ++b){G[b] += h[b]*bi[b];}
+    }
+    const double* bj = beta.colptr(j);
+    const double* gj = cb.g.colptr(j);
+    for (int b=0; b<B; ++b){L[b] += bj[b]*(gj[b] - 0.5*G[b]);}
+  }
+  //N(0, sigmabeta sigdiag_t) on the active coefficients; G counts them.
+  //The terms in log2pi and log sigmabeta are the same for every active
+  //trait and are added once per chain, so the trait loops take no logs
+  for (int b=0; b<B; ++b){G[b] = 0;}
+  for (int t=0; t<T; ++t){
+    const double* a = gam.colptr(t);
+    const double* bt = beta.colptr(t);
+    const double* ds = cb.sigdiag.colptr(t);
+    const double* lds = cb.logsigdiag.colptr(t);
+    for (int b=0; b<B; ++b){
+      double lp = -0.5*(lds[b] + bt[b]*bt[b]/(cb.sigmabeta(b)*ds[b]));
+      P[b] += (a[b] == 1) ? lp : 0;
+      G[b] += a[b];
+    }
+  }
+  for (int b=0; b<B; ++b){
+    P[b] -= 0.5*G[b]*(log2pi + std::log(cb.sigmabeta(b)));
+    G[b] = log_gamma_prior(static_cast<int>(G[b]), T);
+  }
+}
+
+void init_batch(Rng& rng, const std::vector<const Data*>& data,
+                double sigmabeta, int burnin, ChainBatch& cb){
+  int B = data.size();
+  if(B == 0){throw std::invalid_argument("init_batch: no chains");}
+  int T = data[0]->T;
+  for (int b=1; b<B; ++b){
+    if(data[b]->T != T){
+      throw std::invalid_argument("init_batch: chains differ in the number of traits");
+    }
+  }
+  cb.data = data;
+  cb.rng.clear();
+  cb.marcor2.clear();
+  cb.Sigma.resize(B);
+  cb.gam.zeros(B, T); cb.beta.zeros(B, T);
+  cb.sigmabeta.set_size(B); cb.h.set_size(B); cb.sd.set_size(B);
+  cb.xx.set_size(B);
+  ChainState s1, s2;
+  for (int b=0; b<B; ++b){
+    const Data& d = *data[b];
+    if(b == 0 || data[b] != data[b-1]){
+      fill_syy(d.patterns, d.Y);
+      default_starts(d, sigmabeta, s1, s2);
+    }
+    const ChainState& s = (b%2 == 0) ? s1 : s2;
+    cb.gam.row(b) = s.gam.t();
+    cb.beta.row(b) = s.beta.t();
+    cb.Sigma[b] = s.Sigma;
+    cb.sigmabeta(b) = s.sigmabeta;
+    cb.h(b) = s.h;
+    cb.sd(b) = std::sqrt(arma::accu(d.marcor%d.marcor)*0.01);
+    cb.xx(b) = arma::dot(d.X, d.X)/d.X.n_elem;
+    cb.marcor2.push_back(flip_marcor(d.marcor));
+    cb.rng.push_back(NativeRng(draw_seed(rng)));
+  }
+  cb.H.zeros(B, T, T); cb.g.zeros(B, T); cb.c.zeros(B);
+  cb.sigdiag.zeros(B, T); cb.logsigdiag.zeros(B, T); cb.tar.zeros(B, 3);
+  cb.proposed.zeros(2); cb.accepted.zeros(2);
+  cb.burnin = burnin;
+  cb.iter = 0;
+  cb.gamsum.zeros(B, T); cb.betasum.zeros(B, T); cb.hsum.zeros(B);
+  cb.npost = 0;
+  cb.gam2.set_size(B, T); cb.beta2.set_size(B, T); cb.parts.set_size(B, 3);
+  cb.cur.set_size(B); cb.logq.set_size(B); cb.logu.set_size(B); cb.acc.set_size(B);
+  cb.ws.reserve(T);
+}
+
+static void batch_betagam(ChainBatch& cb, const SamplerOptions& opt){
+  //update_betagam_sw() in lockstep: every chain makes the same kind of move
+  //at step i and draws from its own generator in the same order
+  int B = cb.gam.n_rows, T = cb.gam.n_cols;
+  batch_target(cb, cb.gam, cb.beta, cb.parts);
+  for (int b=0; b<B; ++b){cb.cur(b) = arma::accu(cb.parts.row(b));}
+  arma::vec gam1(T), beta1(T), gam2(T), beta2(T);
+  for (int i=1; i<opt.bgiter; ++i){
+    bool sw = (i%10 == 0);
+    int steps = sw ? opt.switer : 1;
+    for (int b=0; b<B; ++b){
+      Rng& rng = cb.rng[b];
+      const arma::rowvec& marcor = cb.data[b]->marcor;
+      double sd = cb.sd(b);
+      gam1 = cb.gam.row(b).t();
+      beta1 = cb.beta.row(b).t();
+      double logq = 0;
+      for (int k=0; k<steps; ++k){
+        int changeind = propose_gamma_sw(rng, gam1, marcor, cb.marcor2[b],
+                                         cb.ws, gam2);
+        for (int t=0; t<T; ++t){
+          beta2(t) = (gam2(t)==1) ? beta1(t) + sd*rng.norm() : 0;
+        }
+        double dbeta = log_dnorm(beta1(changeind)-beta2(changeind), 0, sd);
+        logq += sw_proposal_ratio(marcor, cb.marcor2[b], gam1, gam2, dbeta,
+                                  changeind, gam2(changeind));
+        gam1.swap(gam2);
+        beta1.swap(beta2);
+      }
+      cb.gam2.row(b) = gam1.t();
+      cb.beta2.row(b) = beta1.t();
+      cb.logq(b) = logq;
+      cb.logu(b) = rng.unif();
+    }
+    //accept on the log scale: one log per chain here and a plain
+    //comparison in the acceptance loop
+    for (int b=0; b<B; ++b){cb.logu(b) = std::log(cb.logu(b));}
+    batch_target(cb, cb.gam2, cb.beta2, cb.parts);
+    const double* L = cb.parts.colptr(0);
+    const double* P = cb.parts.colptr(1);
+    const double* G = cb.parts.colptr(2);
+    double* cur = cb.cur.memptr();
+    const double* logq = cb.logq.memptr();
+    const double* logu = cb.logu.memptr();
+    double* acc = cb.acc.memptr();
+    for (int b=0; b<B; ++b){
+      double newtarget = L[b] + P[b] + G[b];
+      bool a = newtarget - cur[b] + logq[b] > logu[b];
+      acc[b] = a;
+      cur[b] = a ? newtarget : cur[b];
+    }
+    for (int t=0; t<T; ++t){
+      double* g1 = cb.gam.colptr(t);
+      double* b1 = cb.beta.colptr(t);
+      const double* g2 = cb.gam2.colptr(t);
+      const double* b2 = cb.beta2.colptr(t);
+      for (int b=0; b<B; ++b){
+        g1[b] = (acc[b] == 1) ? g2[b] : g1[b];
+        b1[b] = (acc[b] == 1) ? b2[b] : b1[b];
+      }
+    }
+    cb.proposed(sw ? 1 : 0) += B;
+    cb.accepted(sw ? 1 : 0) += static_cast<arma::uword>(arma::accu(cb.acc));
+  }
+}
+
+static void batch_h(ChainBatch& cb, int hiter){
+  //update_h() for every chain. sigmabeta(h) = K h/(1-h), and with s active
+  //traits and Q = sum beta_t^2/sigdiag_t over them the log ratio of the
+  //beta priors is -(s log(sb2/sb1) + Q (1/sb2 - 1/sb1))/2
+  int B = cb.gam.n_rows, T = cb.gam.n_cols;
+  arma::vec s(B, arma::fill::zeros), Q(B, arma::fill::zeros);
+  arma::vec act(B, arma::fill::zeros), tot(B, arma::fill::zeros);
+  for (int t=0; t<T; ++t){
+    const double* a = cb.gam.colptr(t);
+    const double* bt = cb.beta.colptr(t);
+    const double* ds = cb.sigdiag.colptr(t);
+    for (int b=0; b<B; ++b){
+      s[b] += a[b];
+      Q[b] += (a[b] == 1) ? bt[b]*bt[b]/ds[b] : 0;
+      act[b] += (a[b] == 1) ? ds[b] : 0;
+      tot[b] += ds[b];
+    }
+  }
+  arma::vec K = tot/(act%cb.xx);
+  //the logs of each step are taken in their own loops, so that the
+  //proposal and acceptance loops are plain arithmetic and selects
+  arma::vec r(B), e(B), hp(B), ratio(B);
+  double* h = cb.h.memptr();
+  for (int i=1; i<hiter; ++i){
+    for (int b=0; b<B; ++b){
+      r(b) = cb.rng[b].unif();
+      e(b) = cb.rng[b].unif();
+    }
+    for (int b=0; b<B; ++b){
+      double h2 = h[b] - 0.1 + 0.2*r[b];
+      h2 = (h2 < 0) ? -h2 : h2;
+      h2 = (h2 > 1) ? 2-h2 : h2;
+      hp[b] = h2;
+      //sb2/sb1
+      ratio[b] = h2*(1-h[b])/(h[b]*(1-h2));
+    }
+    for (int b=0; b<B; ++b){
+      ratio[b] = std::log(ratio[b]);
+      e[b] = std::log(e[b]);
+    }
+    for (int b=0; b<B; ++b){
+      double h2 = hp[b];
+      double sb1 = K[b]*h[b]/(1-h[b]);
+      double sb2 = K[b]*h2/(1-h2);
+      //no active traits: sigmabeta is infinite and every move is accepted;
+      //from h = 0 the current prior has no mass off zero
+      double logA = -0.5*(s[b]*ratio[b] + Q[b]*(1/sb2 - 1/sb1));
+      logA = (s[b] == 0 || sb1 == 0) ? 0 : logA;
+      h[b] = (e[b] < logA) ? h2 : h[b];
+    }
+  }
+  for (int b=0; b<B; ++b){
+    double sb = K[b]*h[b]/(1-h[b]);
+    cb.sigmabeta(b) = std::isfinite(sb) ? sb : 1000;
+  }
+}
+
+void batch_iteration(ChainBatch& cb, const arma::mat& Phi,
+                     const SamplerOptions& opt){
+  if(opt.malaiter > 0 || opt.delayed || opt.swapprob > 0){
+    throw std::invalid_argument("batch_iteration: malaiter, delayed and swapprob are not supported");
+  }
+  int B = cb.gam.n_rows, T = cb.gam.n_cols;
+  int nu = T + 5;
+  for (int b=0; b<B; ++b){set_likelihood(cb, b);}
+  batch_betagam(cb, opt);
+  for (int b=0; b<B; ++b){
+    const Data& d = *cb.data[b];
+    arma::vec beta = cb.beta.row(b).t();
+    cb.Sigma[b] = d.single ?
+      update_Sigma(cb.rng[b], d.n, nu, d.patterns, d.Ypf, beta, Phi) :
+      update_Sigma(cb.rng[b], d.n, nu, d.patterns, d.Yp, beta, Phi);
+    set_likelihood(cb, b);
+  }
+  batch_h(cb, opt.hiter);
+  batch_target(cb, cb.gam, cb.beta, cb.tar);
+  if(++cb.iter >= cb.burnin){
+    cb.gamsum += cb.gam;
+    cb.betasum += cb.beta%cb.gam;
+    cb.hsum += cb.h;
+    cb.npost++;
+  }
+}
+
+}
@@ -0,0 +1,233 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// two chains side by side with the convergence check of run2chains_c
+#include "mcmc_core.h"
+#include <stdexcept>
+
+namespace mcmc {
+
+ChainTrace::ChainTrace(int T, int niter, int k, int burnin, bool models,
+                       TraceSink* sink)
+  : burnin(burnin), gamsum(T, arma::fill::zeros),
+    betasum(T, arma::fill::zeros), npost(0), models(models), registry(T),
+    sink(sink) {
+  if(sink){return;}
+  sb.zeros(niter);
+  h.zeros(niter);
+  tar.zeros(3, niter);
+  if(!models){
+    beta.zeros(T, niter);
+    gam.zeros(T, niter);
+  }
+  if(k > 0){
+    Lambda.zeros(T, k, niter);
+    D.zeros(T, niter);
+  } else {
+    Sigma.zeros(T, T, niter);
+  }
+}
+
+static void store(ChainTrace& trace, int i, const ChainState& state){
+  if(!trace.models){
+    trace.beta.col(i) = state.beta;
+    trace.gam.col(i) = state.gam;
+  }
+  if(trace.Lambda.n_slices > 0){
+    trace.Lambda.slice(i) = state.fac.Lambda;
+    trace.D.col(i) = state.fac.d;
+  } else {
+    trace.Sigma.slice(i) = state.Sigma;
+  }
+  trace.sb(i) = state.sigmabeta;
+  trace.h(i) = state.h;
+  if(i > 0){trace.tar.col(i) = state.tar;}
+}
+
+void ChainTrace::record(int i, const ChainState& state){
+  if(sink){
+    sink->draw(i, state);
+  }else{
+    store(*this, i, state);
+  }
+  if(i >= burnin){
+    gamsum += state.gam;
+    betasum += state.beta % state.gam;
+    npost++;
+    if(models){
+      double lt = (i > 0) ? arma::accu(state.tar) : arma::datum::nan;
+      registry.record(state.gam, state.beta, lt);
+    }
+  }
+}
+
+void ChainTrace::truncate(int i){
+  if(sink){return;}
+  if(!models){
+    beta = beta.cols(0,i);
+    gam = gam.cols(0,i);
+  }
+  if(Sigma.n_slices > 0){Sigma = Sigma.slices(0,i);}
+  if(Lambda.n_slices > 0){
+    Lambda = Lambda.slices(0,i);
+    D = D.cols(0,i);
+  }
+  sb = sb.subvec(0,i);
+  h = h.subvec(0,i);
+  tar = tar.cols(0,i);
+}
+
+static Convergence check_convergence(const ChainTrace& trace1,
+                                     const ChainTrace& trace2){
+  arma::vec rowmean1 = trace1.gamsum / trace1.npost;
+  arma::vec rowmean2 = trace2.gamsum / trace2.npost;
+  if(all(rowmean1<0.5) & all(rowmean2<0.5)){
+    return CONVERGED_NULL;
+  }
+  arma::uvec est1 = find(rowmean1 > 0.5);
+  arma::uvec est2 = find(rowmean2 > 0.5);
+  if(est1.size()==est2.size() && all(est1==est2)){
+    //mean beta over the post burn-in draws that include the trait
+    double diff = 0;
+    for (arma::uword k = 0; k < est1.size(); ++k){
+      int kk = est1(k);
+      double beta1 = trace1.betasum(kk) / trace1.gamsum(kk);
+      double beta2 = trace2.betasum(kk) / trace2.gamsum(kk);
+      diff = diff + (beta1-beta2)*(beta1-beta2);
+    }
+    if(diff/est1.size() < 1e-2){
+      return CONVERGED_BETA;
+    }
+  }
+  return NOT_CONVERGED;
+}
+
+RunResult run_two_chains(Rng& rng, const Data& data, const arma::mat& Phi,
+                         const RunOptions& opt, ChainState& state1,
+                         ChainState& state2, ChainTrace& trace1,
+                         ChainTrace& trace2, std::ostream* log){
+  int T = data.T;
+  int nu = T+5;
+  if(opt.niter < 1){
+    throw std::invalid_argument("niter must be at least 1");
+  }
+  if(opt.ntemps < 1 || opt.maxtemp < 1 || opt.sampler.swapiter < 1){
+    throw std::invalid_argument("ntemps, maxtemp and swapiter must be at least 1");
+  }
+  if(opt.sampler.malaiter < 0){
+    throw std::invalid_argument("malaiter must be non-negative");
+  }
+  if(!(opt.sampler.swapprob >= 0 && opt.sampler.swapprob <= 1)){
+    throw std::invalid_argument("swapprob must be in [0, 1]");
+  }
+  if(opt.nfactors < 0 || opt.nfactors >= T){
+    throw std::invalid_argument("nfactors must be in 0..T-1");
+  }
+  if(opt.nfactors > 0 && opt.sampler.malaiter > 0){
+    throw std::invalid_argument("malaiter is not supported with nfactors > 0");
+  }
+  if(opt.nfactors > 0 && opt.screen > -arma::datum::inf){
+    throw std::invalid_argument("screen is not supported with nfactors > 0");
+  }
+  double Vbeta = sum(data.marcor%data.marcor) * 0.01;
+  if(opt.nfactors > 0){
+    init_factor_cov(rng, data, opt.nfactors, state1.fac);
+    init_factor_cov(rng, data, opt.nfactors, state2.fac);
+  }
+  state1.scale = ProposalScale(T, Vbeta, opt.adapt && opt.burnin > 0);
+  state2.scale = ProposalScale(T, Vbeta, opt.adapt && opt.burnin > 0);
+
+  RunResult res;
+  res.iterations = opt.niter;
+  res.converged = NOT_CONVERGED;
+  res.logbf = arma::datum::nan;
+  if(opt.screen > -arma::datum::inf){
+    //most SNPs of a scan are null; those need not cost 2 x burnin iterations
+    res.logbf = screen_logbf(data, state1.Sigma, state1.sigmabeta);
+    if(!(res.logbf >= opt.screen)){
+      if(log){*log << "log Bayes factor " << res.logbf << " below the screen\n";}
+      trace1.record(0, state1);
+      trace2.record(0, state2);
+      trace1.truncate(0); trace2.truncate(0);
+      res.iterations = 1;
+      res.converged = SCREENED_NULL;
+      res.kernel = opt.sampler.kernel;
+      return res;
+    }
+  }
+  SamplerOptions sampler = opt.sampler;
+  if(opt.nfactors == 0 && sampler.kernel == KERNEL_AUTO){
+    arma::vec cost;
+    sampler.kernel = choose_kernel(data, state1, sampler, opt.tune, &cost);
+    if(log){
+      *log << "likelihood kernel: " << kernel_name(sampler.kernel)
+           << " (rows " << cost(KERNEL_ROWS) << ", suffstat "
+           << cost(KERNEL_SUFFSTAT) << (opt.tune ? " s" : " ops")
+           << " per iteration)\n";
+    }
+  }
+  if(opt.ntemps > 1){
+    init_tempering(rng, opt.ntemps, opt.maxtemp, state1);
+    init_tempering(rng, opt.ntemps, opt.maxtemp, state2);
+  }
+  trace1.record(0, state1);
+  trace2.record(0, state2);
+
+  res.kernel = (opt.nfactors > 0) ? KERNEL_AUTO : sampler.kernel;
+  for (int i=1; i<opt.niter; ++i){
+    //chain 1 update
+    outer_iteration(rng, data, Phi, nu, Vbeta, sampler, state1);
+    trace1.record(i, state1);
+    //chain 2 update
+    outer_iteration(rng, data, Phi, nu, Vbeta, sampler, state2);
+    trace2.record(i, state2);
+    if(i==opt.burnin){
+      freeze_adaptation(state1);
+      freeze_adaptation(state2);
+    }
+
+    //convergence criterion
+    if(i>2*opt.burnin && i%5==0){
+      res.converged = check_convergence(trace1, trace2);
+      if(res.converged != NOT_CONVERGED){
+        if(log){
+          if(res.converged == CONVERGED_NULL){
+            *log << "both chains selected no variables - converged!";
+          }else{
+            *log << "beta difference is small between the two chains - converged!\n";
+          }
+        }
+        trace1.truncate(i); trace2.truncate(i);
+        res.iterations = i+1;
+        break;
+      }
+    }
+    if(log){*log << i << "\n";}
+  }
+  return res;
+}
+
+void default_starts(const Data& data, double sigmabeta, ChainState& state1,
+                    ChainState& state2, const arma::mat& Sigma, int nfactors){
+  int T = data.T;
+  arma::vec sxy = arma::zeros<arma::vec>(T);
+  arma::vec sxx = arma::zeros<arma::vec>(T);
+  for (size_t p=0; p<data.patterns.size(); ++p){
+    const Pattern& pat = data.patterns[p];
+    sxy(pat.obs) += pat.sxy;
+    sxx(pat.obs) += pat.sxx;
+  }
+  state1.gam = arma::ones<arma::vec>(T);
+  state1.beta = sxy/sxx;
+  state1.beta.elem(arma::find_nonfinite(state1.beta)).zeros();
+  state2.gam = arma::zeros<arma::vec>(T);
+  state2.beta = arma::zeros<arma::vec>(T);
+  if(nfactors > 0){
+    state1.Sigma = arma::diagmat(observed_variances(data.Y));
+  }else{
+    state1.Sigma = Sigma.is_empty() ? em_with_zero_mean(data.Y, 100) : Sigma;
+  }
+  state2.Sigma = state1.Sigma;
+  state1.sigmabeta = state2.sigmabeta = sigmabeta;
+  state1.h = state2.h = 0;
+}
+
+}
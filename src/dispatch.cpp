@@ -0,0 +1,105 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// choice of the DenseTarget likelihood kernel. Each outer iteration builds
+// the target twice (for the beta/gamma update and for the final log target)
+// and evaluates it about bgiter times, so a kernel costs two setups and
+// bgiter evaluations per iteration. Where the row kernel and the closed form
+// cross over depends on n, T and the number of distinct missingness
+// patterns, so it is decided per dataset.
+#include "mcmc_core.h"
+#include <chrono>
+#include <stdexcept>
+
+namespace mcmc {
+
+const char* kernel_name(LikelihoodKernel kernel){
+  switch(kernel){
+  case KERNEL_AUTO: return "auto";
+  case KERNEL_ROWS: return "rows";
+  case KERNEL_SUFFSTAT: return "suffstat";
+  }
+  return "unknown";
+}
+
+LikelihoodKernel kernel_from_name(const std::string& name){
+  if(name == "auto"){return KERNEL_AUTO;}
+  if(name == "rows"){return KERNEL_ROWS;}
+  if(name == "suffstat"){return KERNEL_SUFFSTAT;}
+  throw std::invalid_argument("unknown likelihood kernel " + name);
+}
+
+static arma::vec model_cost(const Data& data, int bgiter){
+  //multiply-adds per outer iteration. The row kernel factorises each
+  //pattern's block in its setup (inside every evaluation when T is small
+  //enough for the fixed-size kernels) and then costs a triangular solve
+  //per row; the closed form factorises and inverts each block and forms
+  //its sums in the setup, and an evaluation is a T x T product
+  bool fixed = fixed_t_supported(data.T);
+  double setup_rows = 0, eval_rows = 0, setup_ss = 0;
+  for (size_t p=0; p<data.patterns.size(); ++p){
+    double m = data.patterns[p].obs.n_elem;
+    double r = data.patterns[p].rows.n_elem;
+    double chol = m*m*m/3;
+    if(fixed){
+      eval_rows += chol;
+    }else{
+      setup_rows += 2*chol;
+    }
+    eval_rows += r*(m + m*m/2);
+    setup_ss += 2*chol + m*m*m + 2*m*m;
+  }
+  double T = data.T;
+  arma::vec cost(3);
+  cost(KERNEL_AUTO) = arma::datum::nan;
+  cost(KERNEL_ROWS) = 2*setup_rows + bgiter*eval_rows;
+  cost(KERNEL_SUFFSTAT) = 2*setup_ss + bgiter*T*T;
+  return cost;
+}
+
+template<typename eT>
+static double time_kernel(const Data& data, const std::vector<arma::Mat<eT> >& Yp,
+                          const ChainState& state, int bgiter,
+                          LikelihoodKernel kernel){
+  //seconds per outer iteration, from two setups and a few evaluations
+  if(kernel == KERNEL_SUFFSTAT){fill_syy(data.patterns, data.Y);}
+  typedef std::chrono::steady_clock clock;
+  const int evals = 10;
+  Arena arena;
+  volatile double sink = 0;
+  clock::time_point t0 = clock::now();
+  {
+    DenseTarget<eT> first(data.patterns, Yp, state.sigmabeta, state.Sigma,
+                          kernel);
+  }
+  DenseTarget<eT> target(data.patterns, Yp, state.sigmabeta, state.Sigma,
+                         kernel);
+  clock::time_point t1 = clock::now();
+  for (int k=0; k<evals; ++k){
+    sink = sink + target(state.gam, state.beta, arena);
+  }
+  clock::time_point t2 = clock::now();
+  double setups = std::chrono::duration<double>(t1-t0).count();
+  double eval = std::chrono::duration<double>(t2-t1).count()/evals;
+  return setups + bgiter*eval;
+}
+
+LikelihoodKernel choose_kernel(const Data& data, const ChainState& state,
+                               const SamplerOptions& opt, bool tune,
+                               arma::vec* cost){
+  arma::vec c;
+  if(tune){
+    c.set_size(3);
+    c(KERNEL_AUTO) = arma::datum::nan;
+    for (int k=KERNEL_ROWS; k<=KERNEL_SUFFSTAT; ++k){
+      LikelihoodKernel kernel = static_cast<LikelihoodKernel>(k);
+      c(k) = data.single ?
+        time_kernel(data, data.Ypf, state, opt.bgiter, kernel) :
+        time_kernel(data, data.Yp, state, opt.bgiter, kernel);
+    }
+  }else{
+    c = model_cost(data, opt.bgiter);
+  }
+  if(cost){*cost = c;}
+  return (c(KERNEL_SUFFSTAT) < c(KERNEL_ROWS)) ? KERNEL_SUFFSTAT : KERNEL_ROWS;
+}
+
+}
@@ -0,0 +1,243 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// factor-structured covariance Sigma = Lambda Lambda' + diag(d). Observed
+// blocks are never formed: with L = Lambda_o, D = diag(d_o) and
+// M = I + L'D^-1 L (k x k),
+//   Sigma_oo^-1   = D^-1 - D^-1 L M^-1 L'D^-1    (Woodbury)
+//   log|Sigma_oo| = sum(log d_o) + log|M|         (determinant lemma)
+// and the Gibbs update goes through the latent factors eta_i ~ N(0, I_k).
+#include "mcmc_core.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace mcmc {
+
+static arma::mat chol_upper(const arma::mat& M){
+  arma::mat R;
+  if(!arma::chol(R, M)){
+    throw std::runtime_error("factor covariance: matrix not positive definite");
+  }
+  return R;
+}
+
+static arma::vec std_normal(Rng& rng, int k){
+  arma::vec z(k);
+  for (int j=0; j<k; ++j){z(j) = rng.norm();}
+  return z;
+}
+
+template<typename eT>
+FactorTarget<eT>::FactorTarget(const std::vector<Pattern>& patterns,
+                               const std::vector<arma::Mat<eT> >& Yp,
+                               double sigmabeta, const FactorCov& fac)
+  : patterns(patterns), Yp(Yp), sigmabeta(sigmabeta), fac(fac),
+    sigdiag(fac.diag()), dinv(patterns.size()), W(patterns.size()),
+    logdet(patterns.size()) {
+  for (size_t p=0; p<patterns.size(); ++p){
+    const arma::uvec& obs = patterns[p].obs;
+    arma::mat Lo = fac.Lambda.rows(obs);
+    dinv[p] = 1/fac.d(obs);
+    arma::mat M = Lo.t() * (Lo.each_col() % dinv[p]);
+    M.diag() += 1;
+    arma::mat R = chol_upper(M);
+    W[p] = arma::solve(arma::trimatl(R.t()), Lo.t());
+    logdet(p) = arma::accu(arma::log(fac.d(obs))) +
+      2*arma::accu(arma::log(R.diag()));
+  }
+}
+
+template<typename eT>
+arma::vec FactorTarget<eT>::eval(const arma::vec& gam, const arma::vec& beta,
+                                 Arena& arena) const {
+  //same three parts as get_target(), O(|observed| k) per row
+  int T = fac.Lambda.n_rows;
+  arena.reset();
+  arena.reserve(3*T);
+  double* b = arena.take(T);
+  double* r = arena.take(T);
+  double* u = arena.take(T);
+  double L = 0;
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    const arma::vec& di = dinv[p];
+    const arma::mat& Wp = W[p];
+    const arma::Mat<eT>& y = Yp[p];
+    arma::uword m = pat.obs.n_elem;
+    for (arma::uword o=0; o<m; ++o){b[o] = beta(pat.obs(o));}
+    double quad = 0;
+    for (arma::uword j=0; j<pat.rows.n_elem; ++j){
+      const eT* yj = y.colptr(j);
+      for (arma::uword o=0; o<m; ++o){
+        r[o] = yj[o] - pat.x(j)*b[o];
+        u[o] = di(o)*r[o];
+        quad += r[o]*u[o];
+      }
+      //minus |W u|^2
+      for (arma::uword f=0; f<Wp.n_rows; ++f){
+        double w = 0;
+        for (arma::uword o=0; o<m; ++o){w += Wp(f,o)*u[o];}
+        quad -= w*w;
+      }
+    }
+    L -= 0.5*(pat.rows.n_elem*(m*log2pi + logdet(p)) + quad);
+  }
+  return target_parts(L, sigmabeta, sigdiag, gam, beta);
+}
+
+static int local_index(const arma::uvec& obs, int t){
+  //position of trait t in the increasing obs, -1 if not observed
+  const arma::uword* first = obs.memptr();
+  const arma::uword* last = first + obs.n_elem;
+  const arma::uword* it = std::lower_bound(first, last, arma::uword(t));
+  return (it != last && *it == arma::uword(t)) ? int(it - first) : -1;
+}
+
+template<typename eT>
+double FactorTarget<eT>::pair_delta(const arma::vec& gam1, const arma::vec& beta1,
+                                    double cur, const arma::vec& gam2,
+                                    const arma::vec& beta2, int i, int j,
+                                    Arena& arena) const {
+  //the sums are double; on float values they would not match eval()
+  if(sizeof(eT) != sizeof(double)){
+    return Target::pair_delta(gam1, beta1, cur, gam2, beta2, i, j, arena);
+  }
+  //per pattern, with d = beta2 - beta1 (zero outside i, j) and
+  //v = sxy - sxx (beta1 + beta2)/2 on the observed traits, the likelihood
+  //changes by d'Sigma_oo^-1 v = d'D^-1 v - (W D^-1 d)'(W D^-1 v)
+  int k = fac.Lambda.n_cols;
+  arena.reset();
+  arena.reserve(2*k);
+  double* wd = arena.take(k);
+  double* wv = arena.take(k);
+  double dL = 0;
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    const int changed[2] = {local_index(pat.obs, i), local_index(pat.obs, j)};
+    if(changed[0] < 0 && changed[1] < 0){continue;}
+    const arma::vec& di = dinv[p];
+    const arma::mat& Wp = W[p];
+    for (int f=0; f<k; ++f){wd[f] = 0; wv[f] = 0;}
+    for (arma::uword o=0; o<pat.obs.n_elem; ++o){
+      arma::uword t = pat.obs(o);
+      double u = di(o)*(pat.sxy(o) - 0.5*pat.sxx*(beta1(t) + beta2(t)));
+      const double* w = Wp.colptr(o);
+      for (int f=0; f<k; ++f){wv[f] += w[f]*u;}
+    }
+    for (int c=0; c<2; ++c){
+      int o = changed[c];
+      if(o < 0){continue;}
+      arma::uword t = pat.obs(o);
+      double u = di(o)*(beta2(t) - beta1(t));
+      dL += u*(pat.sxy(o) - 0.5*pat.sxx*(beta1(t) + beta2(t)));
+      const double* w = Wp.colptr(o);
+      for (int f=0; f<k; ++f){wd[f] += w[f]*u;}
+    }
+    for (int f=0; f<k; ++f){dL -= wd[f]*wv[f];}
+  }
+  return dL + prior_pair_delta(sigmabeta, sigdiag, gam1, beta1, gam2, beta2,
+                               i, j);
+}
+
+arma::vec observed_variances(const arma::mat& Y){
+  arma::vec out(Y.n_cols);
+  for (arma::uword t=0; t<Y.n_cols; ++t){
+    arma::vec y = Y.col(t);
+    y = y(arma::find_finite(y));
+    double v = (y.n_elem > 1) ? arma::var(y) : 1;
+    if(!(v > 0) || !std::isfinite(v)){v = 1;}
+    out(t) = v;
+  }
+  return out;
+}
+
+void init_factor_cov(Rng& rng, const Data& data, int k, FactorCov& fac){
+  if(k < 1){
+    throw std::invalid_argument("init_factor_cov: need at least one factor");
+  }
+  int T = data.T;
+  fac.Lambda.set_size(T, k);
+  fac.d.set_size(T);
+  arma::vec var = observed_variances(data.Y);
+  for (int t=0; t<T; ++t){
+    double v = var(t);
+    //half the variance to d, half (in expectation) to the factors
+    fac.d(t) = 0.5*v;
+    for (int j=0; j<k; ++j){
+      fac.Lambda(t,j) = std::sqrt(0.5*v/k)*rng.norm();
+    }
+  }
+}
+
+template<typename eT>
+void update_factor_cov(Rng& rng, const std::vector<Pattern>& patterns,
+                       const std::vector<arma::Mat<eT> >& Yp,
+                       const arma::vec& beta, const FactorPrior& prior,
+                       FactorCov& fac){
+  int T = fac.Lambda.n_rows;
+  int k = fac.Lambda.n_cols;
+  //per trait, over the rows where it is observed: sum eta eta', sum eta r,
+  //sum r^2 and the count
+  std::vector<arma::mat> S(T, arma::zeros<arma::mat>(k,k));
+  arma::mat C = arma::zeros<arma::mat>(k,T);
+  arma::vec rr = arma::zeros<arma::vec>(T);
+  arma::vec nobs = arma::zeros<arma::vec>(T);
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    arma::uword m = pat.obs.n_elem;
+    arma::mat G = fac.Lambda.rows(pat.obs);
+    G.each_col() /= fac.d(pat.obs);
+    //eta_i | r_i ~ N(M^-1 L'D^-1 r_i, M^-1), M = I + L'D^-1 L = R'R
+    arma::mat M = fac.Lambda.rows(pat.obs).t() * G;
+    M.diag() += 1;
+    arma::mat R = chol_upper(M);
+    arma::mat Rinv = arma::inv(arma::trimatu(R));
+    arma::mat A = Rinv * Rinv.t() * G.t();  //M^-1 L'D^-1
+    arma::mat Sp = arma::zeros<arma::mat>(k,k);
+    arma::vec r(m);
+    for (arma::uword j=0; j<pat.rows.n_elem; ++j){
+      const eT* yj = Yp[p].colptr(j);
+      for (arma::uword o=0; o<m; ++o){
+        r(o) = yj[o] - pat.x(j)*beta(pat.obs(o));
+      }
+      arma::vec eta = A*r + Rinv*std_normal(rng, k);
+      Sp += eta*eta.t();
+      for (arma::uword o=0; o<m; ++o){
+        arma::uword t = pat.obs(o);
+        C.col(t) += eta*r(o);
+        rr(t) += r(o)*r(o);
+      }
+    }
+    for (arma::uword o=0; o<m; ++o){
+      S[pat.obs(o)] += Sp;
+      nobs(pat.obs(o)) += pat.rows.n_elem;
+    }
+  }
+  //lambda_t | eta, d_t, then d_t | eta, lambda_t
+  for (int t=0; t<T; ++t){
+    arma::mat Q = S[t]/fac.d(t);
+    Q.diag() += prior.lambda_prec;
+    arma::mat R = chol_upper(Q);
+    arma::mat Rinv = arma::inv(arma::trimatu(R));
+    arma::vec mu = Rinv * (Rinv.t() * C.col(t)) / fac.d(t);
+    arma::vec lambda = mu + Rinv*std_normal(rng, k);
+    fac.Lambda.row(t) = lambda.t();
+    double sse = rr(t) - 2*arma::dot(lambda, C.col(t)) +
+      arma::dot(lambda, S[t]*lambda);
+    sse = std::max(sse, 0.0);
+    double shape = prior.a + 0.5*nobs(t);
+    double rate = prior.b + 0.5*sse;
+    //1/d_t ~ gamma(shape, rate) = chisq(2 shape)/(2 rate)
+    fac.d(t) = 2*rate/rng.chisq(2*shape);
+  }
+}
+
+template class FactorTarget<double>;
+template class FactorTarget<float>;
+template void update_factor_cov(Rng&, const std::vector<Pattern>&,
+                                const std::vector<arma::mat>&, const arma::vec&,
+                                const FactorPrior&, FactorCov&);
+template void update_factor_cov(Rng&, const std::vector<Pattern>&,
+                                const std::vector<arma::fmat>&, const arma::vec&,
+                                const FactorPrior&, FactorCov&);
+
+}
@@ -0,0 +1,205 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// kernels for small T with sizes fixed at compile time. For T <= 8 the
+// per-row dmvnrm() in get_target() spends most of its time allocating index
+// vectors and submatrices and calling LAPACK on 2x2 to 8x8 blocks; here the
+// blocks are factorised once per missingness pattern into stack arrays and
+// every row is a forward substitution. Dispatch on T happens once per call.
+#include "mcmc_core.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace mcmc {
+
+//lower Cholesky factor of the leading m x m block of S (only the lower
+//triangle is read); false if it is not positive definite
+template<int N>
+static bool chol_lower(const double (&S)[N][N], int m, double (&L)[N][N]){
+  for (int j=0; j<m; ++j){
+    double d = S[j][j];
+    for (int k=0; k<j; ++k){d -= L[j][k]*L[j][k];}
+    if(!(d > 0)){return false;}
+    d = std::sqrt(d);
+    L[j][j] = d;
+    for (int i=j+1; i<m; ++i){
+      double s = S[i][j];
+      for (int k=0; k<j; ++k){s -= L[i][k]*L[j][k];}
+      L[i][j] = s/d;
+    }
+    for (int i=0; i<j; ++i){L[i][j] = 0;}
+  }
+  return true;
+}
+
+//inverse of a lower triangular N x N matrix
+template<int N>
+static void inv_lower(const double (&L)[N][N], double (&Li)[N][N]){
+  for (int j=0; j<N; ++j){
+    for (int i=0; i<j; ++i){Li[i][j] = 0;}
+    Li[j][j] = 1/L[j][j];
+    for (int i=j+1; i<N; ++i){
+      double s = 0;
+      for (int k=j; k<i; ++k){s += L[i][k]*Li[k][j];}
+      Li[i][j] = -s/L[i][i];
+    }
+  }
+}
+
+template<int N, typename eT>
+static double loglik_fixed(const std::vector<Pattern>& patterns,
+                           const std::vector<arma::Mat<eT> >& Yp,
+                           const arma::mat& Sigma, const arma::vec& beta){
+  double S[N][N], L[N][N], dinv[N], b[N], r[N];
+  int idx[N];
+  double out = 0;
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    int m = 0;
+    for (int t=0; t<N; ++t){
+      if((pat.mask >> t) & 1u){idx[m++] = t;}
+    }
+    for (int i=0; i<m; ++i){
+      for (int j=0; j<=i; ++j){S[i][j] = Sigma(idx[i], idx[j]);}
+    }
+    if(!chol_lower<N>(S, m, L)){
+      throw std::runtime_error("get_target: Sigma is not positive definite");
+    }
+    double logdet = 0;
+    for (int j=0; j<m; ++j){
+      logdet += std::log(L[j][j]);
+      dinv[j] = 1/L[j][j];
+      b[j] = beta(idx[j]);
+    }
+    //sum over rows of |L^-1 (y_o - x beta_o)|^2
+    double quad = 0;
+    const arma::Mat<eT>& y = Yp[p];
+    for (arma::uword k=0; k<pat.rows.n_elem; ++k){
+      const eT* yk = y.colptr(k);
+      double x = pat.x(k);
+      for (int j=0; j<m; ++j){
+        double s = yk[j] - x*b[j];
+        for (int l=0; l<j; ++l){s -= L[j][l]*r[l];}
+        r[j] = s*dinv[j];
+        quad += r[j]*r[j];
+      }
+    }
+    out -= 0.5*quad + pat.rows.n_elem*(0.5*m*log2pi + logdet);
+  }
+  return out;
+}
+
+template<typename eT>
+static double loglik_fixed_t(const std::vector<Pattern>& patterns,
+                             const std::vector<arma::Mat<eT> >& Yp,
+                             const arma::mat& Sigma, const arma::vec& beta){
+  switch(Sigma.n_rows){
+  case 1: return loglik_fixed<1>(patterns, Yp, Sigma, beta);
+  case 2: return loglik_fixed<2>(patterns, Yp, Sigma, beta);
+  case 3: return loglik_fixed<3>(patterns, Yp, Sigma, beta);
+  case 4: return loglik_fixed<4>(patterns, Yp, Sigma, beta);
+  case 5: return loglik_fixed<5>(patterns, Yp, Sigma, beta);
+  case 6: return loglik_fixed<6>(patterns, Yp, Sigma, beta);
+  case 7: return loglik_fixed<7>(patterns, Yp, Sigma, beta);
+  case 8: return loglik_fixed<8>(patterns, Yp, Sigma, beta);
+  default:
+    throw std::invalid_argument("get_target_fixed: T out of range");
+  }
+}
+
+template<typename eT>
+arma::vec get_target_fixed(const std::vector<Pattern>& patterns,
+                           const std::vector<arma::Mat<eT> >& Yp,
+                           double sigmabeta, const arma::mat& Sigma,
+                           const arma::vec& gam, const arma::vec& beta){
+  int T = Sigma.n_rows;
+  double B = 0;
+  int s = 0;
+  for (int t=0; t<T; ++t){
+    if(gam(t)==1){
+      B += log_dnorm(beta(t), 0, std::sqrt(sigmabeta*Sigma(t,t)));
+      ++s;
+    }
+  }
+  arma::vec out(3);
+  out(0) = loglik_fixed_t(patterns, Yp, Sigma, beta);
+  out(1) = B;
+  out(2) = log_gamma_prior(s, T);
+  return out;
+}
+
+template<int N>
+static arma::mat rinvwish_fixed_n(Rng& rng, int v, const arma::mat& S){
+  //the steps of rinvwish(): L = chol(S^-1), A the Bartlett factor,
+  //draw = (LA)^-T (LA)^-1
+  double Sa[N][N], C[N][N], Ci[N][N], Si[N][N], L[N][N], A[N][N], M[N][N],
+    Mi[N][N];
+  for (int i=0; i<N; ++i){
+    for (int j=0; j<N; ++j){Sa[i][j] = S(i,j);}
+  }
+  if(!chol_lower<N>(Sa, N, C)){
+    throw std::runtime_error("rinvwish: S is not positive definite");
+  }
+  //S^-1 = C^-T C^-1
+  inv_lower<N>(C, Ci);
+  for (int i=0; i<N; ++i){
+    for (int j=0; j<=i; ++j){
+      double s = 0;
+      for (int k=i; k<N; ++k){s += Ci[k][i]*Ci[k][j];}
+      Si[i][j] = s;
+    }
+  }
+  if(!chol_lower<N>(Si, N, L)){
+    throw std::runtime_error("rinvwish: S is not positive definite");
+  }
+  //same draw order as rinvwish()
+  for (int i=0; i<N; ++i){
+    for (int j=0; j<N; ++j){A[i][j] = 0;}
+    A[i][i] = std::sqrt(rng.chisq(v - i));
+  }
+  for (int row=1; row<N; ++row){
+    for (int col=0; col<row; ++col){A[row][col] = rng.norm();}
+  }
+  for (int i=0; i<N; ++i){
+    for (int j=0; j<N; ++j){
+      double s = 0;
+      for (int k=j; k<=i; ++k){s += L[i][k]*A[k][j];}
+      M[i][j] = (j <= i) ? s : 0;
+    }
+  }
+  inv_lower<N>(M, Mi);
+  arma::mat out(N, N);
+  for (int i=0; i<N; ++i){
+    for (int j=0; j<=i; ++j){
+      double s = 0;
+      for (int k=i; k<N; ++k){s += Mi[k][i]*Mi[k][j];}
+      out(i,j) = s;
+      out(j,i) = s;
+    }
+  }
+  return out;
+}
+
+arma::mat rinvwish_fixed(Rng& rng, int v, const arma::mat& S){
+  switch(S.n_rows){
+  case 1: return rinvwish_fixed_n<1>(rng, v, S);
+  case 2: return rinvwish_fixed_n<2>(rng, v, S);
+  case 3: return rinvwish_fixed_n<3>(rng, v, S);
+  case 4: return rinvwish_fixed_n<4>(rng, v, S);
+  case 5: return rinvwish_fixed_n<5>(rng, v, S);
+  case 6: return rinvwish_fixed_n<6>(rng, v, S);
+  case 7: return rinvwish_fixed_n<7>(rng, v, S);
+  case 8: return rinvwish_fixed_n<8>(rng, v, S);
+  default:
+    throw std::invalid_argument("rinvwish_fixed: dimension out of range");
+  }
+}
+
+template arma::vec get_target_fixed(const std::vector<Pattern>&,
+                                    const std::vector<arma::mat>&, double,
+                                    const arma::mat&, const arma::vec&,
+                                    const arma::vec&);
+template arma::vec get_target_fixed(const std::vector<Pattern>&,
+                                    const std::vector<arma::fmat>&, double,
+                                    const arma::mat&, const arma::vec&,
+                                    const arma::vec&);
+
+}
@@ -0,0 +1,55 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// Metropolis-adjusted Langevin update of beta for fixed gamma, Sigma and
+// sigmabeta. Given those, log target = g'b - b'Q b/2 + const on the active
+// set, with Q = H + diag(1/(sigmabeta*Sigma_tt)), so gradient and target
+// differences come from the pattern statistics without touching Y.
+#include "mcmc_core.h"
+
+namespace mcmc {
+
+void update_beta_mala(Rng& rng, const BetaQuadratic& q, const arma::mat& Sigma,
+                      double sigmabeta, const arma::vec& gam, arma::vec& beta,
+                      int niter, ProposalScale& scale){
+  arma::uvec a = find(gam==1);
+  int s = a.n_elem;
+  if(s==0 || niter<1){return;}
+  arma::vec ds = Sigma.diag();
+  arma::mat Q = q.H(a,a);
+  for (int k=0; k<s; ++k){
+    Q(k,k) += 1/(sigmabeta*ds(a(k)));
+  }
+  arma::vec g = q.g(a);
+  //preconditioner: inverse diagonal of Q
+  arma::vec m = 1/Q.diag();
+  arma::vec sqm = arma::sqrt(m);
+  arma::vec b = beta(a);
+  arma::vec grad = g - Q*b;
+  double f = 0.5*arma::dot(b, g+grad);
+  arma::vec z(s);
+  for (int it=0; it<niter; ++it){
+    double eps = std::exp(scale.mala_logeps);
+    for (int k=0; k<s; ++k){z(k) = rng.norm();}
+    arma::vec b2 = b + 0.5*eps*eps*(m%grad) + eps*(sqm%z);
+    arma::vec grad2 = g - Q*b2;
+    double f2 = 0.5*arma::dot(b2, g+grad2);
+    //log q(b | b2) - log q(b2 | b)
+    arma::vec r = (b - b2 - 0.5*eps*eps*(m%grad2))/(eps*sqm);
+    double logA = f2 - f - 0.5*arma::dot(r,r) + 0.5*arma::dot(z,z);
+    scale.proposed(2)++;
+    if(scale.adapt){
+      //Robbins-Monro towards the optimal MALA acceptance rate 0.574
+      double alpha = (logA >= 0) ? 1 : std::exp(logA);
+      if(!arma::is_finite(alpha)){alpha = 0;}
+      scale.mala_nadapt++;
+      scale.mala_logeps += std::pow(static_cast<double>(scale.mala_nadapt), -0.6) *
+        (alpha - 0.574);
+    }
+    if(std::exp(logA) > rng.unif()){
+      b = b2; grad = grad2; f = f2;
+      scale.accepted(2)++;
+    }
+  }
+  beta(a) = b;
+}
+
+}
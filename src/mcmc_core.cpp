@@ -0,0 +1,1365 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+#include "mcmc_core.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace mcmc {
+
+double log_dnorm(double x, double mu, double sd){
+  //log normal density, same edge cases as R::dnorm(x, mu, sd, true)
+  if(std::isnan(x) || std::isnan(mu) || std::isnan(sd)){return x + mu + sd;}
+  if(sd < 0){return arma::datum::nan;}
+  if(!std::isfinite(sd)){return -arma::datum::inf;}
+  if(!std::isfinite(x) && x == mu){return arma::datum::nan;}
+  if(sd == 0){return (x == mu) ? arma::datum::inf : -arma::datum::inf;}
+  double z = (x - mu)/sd;
+  if(!std::isfinite(z)){return -arma::datum::inf;}
+  return -(0.5*log2pi + 0.5*z*z + std::log(sd));
+}
+
+double dmvnrm(const arma::rowvec& x,
+              const arma::rowvec& mean,
+              const arma::mat& sigma,
+              bool logd){
+  //returns the density of a multivariate normal vector
+  int xdim = x.n_cols;
+  if(xdim==0){return 0;}
+  double out;
+  arma::mat rooti = arma::trans(arma::inv(trimatu(arma::chol(sigma))));
+  double rootisum = arma::sum(log(rooti.diag()));
+  double constants = -(static_cast<double>(xdim)/2.0) * log2pi;
+  arma::vec z = rooti*arma::trans(x-mean);
+  out = constants - 0.5*arma::sum(z%z)+rootisum;
+  if (logd == false) {
+    out = std::exp(out);
+  }
+  return(out);
+}
+
+arma::mat mvrnorm(Rng& rng, int n, const arma::vec& mu, const arma::mat& Sigma){
+  //returns random multivariate normal vectors with mean mu and covariance Sigma
+  int ncols = Sigma.n_cols;
+  arma::mat Y(n, ncols);
+  for (arma::uword k=0; k<Y.n_elem; ++k){
+    Y(k) = rng.norm();
+  }
+  return arma::repmat(mu, 1, n).t() + Y * arma::chol(Sigma);
+}
+
+arma::cube rinvwish(Rng& rng, int n, int v, const arma::mat& S){
+  //draw a matrix from inverse wishart distribution with parameters S and v
+  int p = S.n_rows;
+  arma::cube sims(p, p, n, arma::fill::zeros);
+  if(fixed_t_supported(p)){
+    for (int j=0; j<n; ++j){sims.slice(j) = rinvwish_fixed(rng, v, S);}
+    return sims;
+  }
+  arma::mat L = chol(inv_sympd(S), "lower");
+  for(int j = 0; j < n; j++){
+    arma::mat A(p,p, arma::fill::zeros);
+    for(int i = 0; i < p; i++){
+      int df = v - (i + 1) + 1; //zero-indexing
+      A(i,i) = std::sqrt(rng.chisq(df));
+    }
+    for(int row = 1; row < p; row++){
+      for(int col = 0; col < row; col++){
+        A(row, col) = rng.norm();
+      }
+    }
+    arma::mat LA_inv = inv(trimatl(trimatl(L) * trimatl(A)));
+    sims.slice(j) = LA_inv.t() * LA_inv;
+  }
+  return(sims);
+}
+
+int sample_uniform(Rng& rng, int size){
+  //sample one index from 0:(size-1)
+  int k = static_cast<int>(rng.unif() * size);
+  return (k < size) ? k : size-1;
+}
+
+int sample_index(Rng& rng, const double* prob, int n){
+  //sample one index from 0:(n-1) with probability proportional to prob
+  double total = 0;
+  for (int k=0; k<n; ++k){total += prob[k];}
+  if(!(total > 0) || !std::isfinite(total)){
+    return sample_uniform(rng, n);
+  }
+  double u = rng.unif() * total;
+  double cum = 0;
+  for (int k=0; k<n; ++k){
+    cum += prob[k];
+    if(u < cum){return k;}
+  }
+  return n-1;
+}
+
+int sample_index(Rng& rng, const arma::vec& prob){
+  return sample_index(rng, prob.memptr(), prob.n_elem);
+}
+
+template<typename eT>
+double marginal_cor_col(const arma::vec& X, const arma::Mat<eT>& Y, arma::uword t){
+  //mean of X*Y[,t] over the non-missing entries of column t
+  const eT* y = Y.colptr(t);
+  double s = 0;
+  arma::uword cnt = 0;
+  for (arma::uword i=0; i<Y.n_rows; ++i){
+    if(std::isfinite(y[i])){
+      s += static_cast<double>(y[i])*X(i);
+      ++cnt;
+    }
+  }
+  return s/cnt;
+}
+
+template<typename eT>
+arma::rowvec marginal_cor(const arma::vec& X, const arma::Mat<eT>& Y){
+  arma::rowvec marcor(Y.n_cols);
+  for (arma::uword t=0; t<Y.n_cols; ++t){
+    marcor(t) = marginal_cor_col(X, Y, t);
+  }
+  return marcor;
+}
+
+static void check_columns(const arma::mat& Y){
+  for (arma::uword t=0; t<Y.n_cols; ++t){
+    const double* y = Y.colptr(t);
+    bool any = false;
+    for (arma::uword i=0; i<Y.n_rows && !any; ++i){any = std::isfinite(y[i]);}
+    if(!any){
+      throw std::invalid_argument("a column of Y has no observed values");
+    }
+  }
+}
+
+Data::Data(const arma::vec& X_, const arma::mat& Y_, bool single_,
+           const arma::mat& Z)
+  : X(Z.n_cols > 0 ? Xadj : X_), Y(Z.n_cols > 0 ? Yadj : Y_), single(single_) {
+  n = Y_.n_rows;
+  T = Y_.n_cols;
+  if(n==0 || T==0){
+    throw std::invalid_argument("Y has no rows or no columns");
+  }
+  if(X_.n_elem != Y_.n_rows){
+    throw std::invalid_argument("length(X) must equal nrow(Y)");
+  }
+  if(!X_.is_finite()){
+    throw std::invalid_argument("X has missing or infinite values");
+  }
+  check_columns(Y_);
+  if(Z.n_cols > 0){
+    if(Z.n_rows != Y_.n_rows){
+      throw std::invalid_argument("nrow(covariates) must equal nrow(Y)");
+    }
+    if(!Z.is_finite()){
+      throw std::invalid_argument("covariates have missing or infinite values");
+    }
+    Xadj = X_;
+    Yadj = Y_;
+    project_covariates(Z, missing_patterns(X_, Y_), Xadj, Yadj);
+  }
+  //one-off summaries from the double data; the sampler only reads the
+  //packed values
+  patterns = missing_patterns(X, Y);
+  marcor = arma::abs(marginal_cor(patterns, T));
+  if(single){
+    Ypf = pack_patterns<float>(Y, patterns);
+  }else{
+    Yp = pack_patterns<double>(Y, patterns);
+  }
+}
+
+//rows per task of crossprod() and of the EM's E-step. Fixed, so that
+//partial sums are added in the same order whatever the number of threads
+static const int em_block = 4096;
+
+static int row_blocks(arma::uword n){
+  return (n + em_block - 1)/em_block;
+}
+
+template<typename eT>
+static arma::mat crossprod(const arma::Mat<eT>& A){
+  //A'A in double, one row block per task. Each block is one SYRK (Armadillo
+  //maps B.t()*B to it) and the blocks are added in order
+  int nb = row_blocks(A.n_rows);
+  std::vector<arma::mat> part(nb);
+  std::string err;
+#pragma omp parallel for schedule(dynamic)
+  for (int b=0; b<nb; ++b){
+    try {
+      arma::uword first = static_cast<arma::uword>(b)*em_block;
+      arma::uword last = std::min<arma::uword>(first+em_block, A.n_rows) - 1;
+      arma::mat Ab = arma::conv_to<arma::mat>::from(A.rows(first, last));
+      part[b] = Ab.t() * Ab;
+    } catch (std::exception& e) {
+#pragma omp critical
+      err = e.what();
+    }
+  }
+  if(!err.empty()){throw std::runtime_error(err);}
+  arma::mat out = arma::zeros<arma::mat>(A.n_cols, A.n_cols);
+  for (int b=0; b<nb; ++b){out += part[b];}
+  return out;
+}
+
+template<typename eT>
+static arma::mat estep_rows(const arma::Mat<eT>& y, const arma::mat& Sigma,
+                            arma::uword first, arma::uword last,
+                            arma::Mat<eT>& y_imputed){
+  //imputes the missing entries of rows first..last by their conditional
+  //means given Sigma and returns the sum of their conditional covariances.
+  //Consecutive rows missing the same traits share one regression
+  arma::uword p = y.n_cols;
+  arma::mat bias = arma::zeros<arma::mat>(p,p);
+  arma::uvec prev;
+  arma::mat K, V;
+  for (arma::uword i=first; i<=last; ++i){
+    arma::rowvec tempdat = arma::conv_to<arma::rowvec>::from(y.row(i));
+    arma::uvec ind = find_finite(tempdat);
+    arma::uvec nind = find_nonfinite(tempdat);
+    if (0 < ind.n_elem && ind.n_elem < p){
+      if(K.is_empty() || nind.n_elem != prev.n_elem || arma::any(nind != prev)){
+        K = Sigma(nind, ind) * (Sigma(ind, ind).i());
+        V = Sigma(nind, nind) - K * Sigma(ind, nind);
+        prev = nind;
+      }
+      bias(nind, nind) += V;
+      arma::vec imp = K*tempdat(ind).t();
+      for (arma::uword k=0; k<nind.n_elem; ++k){
+        y_imputed(i, nind(k)) = static_cast<eT>(imp(k));
+      }
+    }
+  }
+  return bias;
+}
+
+template<typename eT>
+arma::mat em_with_zero_mean(const arma::Mat<eT>& y_in, int maxit){
+  //EM for empirical covariance matrix when y has missing values. y may be
+  //float; Sigma and all sums are double
+  int orig_p = y_in.n_cols;
+  arma::vec vars = arma::zeros<arma::vec>(orig_p);
+  for (int i=0; i < orig_p; ++i){
+    arma::vec ycol = arma::conv_to<arma::vec>::from(y_in.col(i));
+    arma::uvec finiteind = find_finite(ycol);
+    arma::vec yy = ycol(finiteind);
+    vars(i) = sum((yy-mean(yy))%(yy-mean(yy)));
+  }
+  arma::uvec valid_ind = find(vars>1e-6);
+  arma::Mat<eT> y = y_in.cols(valid_ind);
+  arma::uword p = y.n_cols;
+  int n = y.n_rows;
+  arma::Mat<eT> y_imputed = y;
+  for (arma::uword j = 0; j < p; ++j){
+    arma::uvec colind = arma::zeros<arma::uvec>(1);
+    colind(0) = j;
+    arma::uvec nawhere = find_nonfinite(y_imputed.col(j));
+    arma::uvec nonnawhere = find_finite(y_imputed.col(j));
+    arma::vec tempcolmean = mean(arma::conv_to<arma::mat>::from(
+                                   y_imputed(nonnawhere, colind)), 0);
+    y_imputed(nawhere, colind).fill(static_cast<eT>(tempcolmean(0)));
+  }
+  arma::mat oldSigma = crossprod(y_imputed) / n;
+  arma::mat Sigma = oldSigma;
+  double diff = 1;
+  int it = 1;
+  int nb = row_blocks(n);
+  std::vector<arma::mat> part(nb);
+  while (diff>0.001 && it < maxit){
+    //E-step over row blocks in parallel; blocks write disjoint rows of
+    //y_imputed and their biases are added in block order
+    std::string err;
+#pragma omp parallel for schedule(dynamic)
+    for (int b=0; b<nb; ++b){
+      try {
+        arma::uword first = static_cast<arma::uword>(b)*em_block;
+        arma::uword last = std::min<arma::uword>(first+em_block, n) - 1;
+        part[b] = estep_rows(y, Sigma, first, last, y_imputed);
+      } catch (std::exception& e) {
+#pragma omp critical
+        err = e.what();
+      }
+    }
+    if(!err.empty()){throw std::runtime_error(err);}
+    arma::mat bias = arma::zeros<arma::mat>(p,p);
+    for (int b=0; b<nb; ++b){bias += part[b];}
+    Sigma = (crossprod(y_imputed) + bias)/n;
+    arma::mat diffmat = (Sigma-oldSigma);
+    arma::mat diffsq = diffmat%diffmat;
+    diff = accu(diffsq);
+    oldSigma = Sigma;
+    it = it + 1;
+  }
+  arma::mat finalSigma = arma::zeros<arma::mat>(orig_p, orig_p);
+  finalSigma.submat(valid_ind, valid_ind) = Sigma;
+  return finalSigma;
+}
+
+template<typename eT>
+arma::mat em_with_zero_mean(const std::vector<Pattern>& patterns,
+                            const std::vector<arma::Mat<eT> >& Yp,
+                            const arma::vec& beta, int n, int maxit){
+  //the iteration of the dense version with the rows of a pattern taken
+  //together: imputed rows are K y_o with K fixed within the pattern, so
+  //crossprod(y_imputed) only needs each pattern's S = sum y_o y_o' and
+  //s = sum y_o
+  int orig_p = beta.n_elem;
+  size_t P = patterns.size();
+  std::vector<arma::mat> S(P);
+  std::vector<arma::vec> s(P);
+  arma::vec colsum = arma::zeros<arma::vec>(orig_p);
+  arma::vec colsq = arma::zeros<arma::vec>(orig_p);
+  arma::vec cnt = arma::zeros<arma::vec>(orig_p);
+  for (size_t p=0; p<P; ++p){
+    const Pattern& pat = patterns[p];
+    arma::uword m = pat.obs.n_elem;
+    arma::mat R(m, pat.rows.n_elem);
+    arma::vec b = beta(pat.obs);
+    for (arma::uword k=0; k<pat.rows.n_elem; ++k){
+      const eT* y = Yp[p].colptr(k);
+      for (arma::uword j=0; j<m; ++j){R(j,k) = y[j] - pat.x(k)*b(j);}
+    }
+    S[p] = R * R.t();
+    s[p] = arma::sum(R, 1);
+    colsum(pat.obs) += s[p];
+    colsq(pat.obs) += S[p].diag();
+    cnt(pat.obs) += pat.rows.n_elem;
+  }
+  arma::vec vars = colsq - colsum%colsum/cnt;
+  arma::uvec valid_ind = find(vars>1e-6);
+  arma::uword p = valid_ind.n_elem;
+  //position of each trait among the valid ones, or -1
+  arma::ivec pos(orig_p);
+  pos.fill(-1);
+  for (arma::uword j=0; j<p; ++j){pos(valid_ind(j)) = j;}
+  arma::vec mu = colsum(valid_ind)/cnt(valid_ind);
+
+  //per pattern: o indexes the valid observed traits within the block and
+  //within the valid set, nv the valid missing ones
+  std::vector<arma::uvec> oblk(P), o(P), nv(P);
+  double n0 = n;
+  for (size_t q=0; q<P; ++q){
+    const Pattern& pat = patterns[q];
+    std::vector<arma::uword> ob, ov;
+    std::vector<bool> seen(p, false);
+    for (arma::uword j=0; j<pat.obs.n_elem; ++j){
+      int v = pos(pat.obs(j));
+      if(v >= 0){ob.push_back(j); ov.push_back(v); seen[v] = true;}
+    }
+    std::vector<arma::uword> mv;
+    for (arma::uword v=0; v<p; ++v){if(!seen[v]){mv.push_back(v);}}
+    oblk[q] = arma::conv_to<arma::uvec>::from(ob);
+    o[q] = arma::conv_to<arma::uvec>::from(ov);
+    nv[q] = arma::conv_to<arma::uvec>::from(mv);
+    if(!ob.empty()){n0 -= patterns[q].rows.n_elem;}
+  }
+  //rows with nothing valid observed stay at the column means throughout
+  arma::mat C0 = n0 * mu * mu.t();
+
+  //start from mean imputation
+  arma::mat C = C0;
+  for (size_t q=0; q<P; ++q){
+    if(o[q].is_empty()){continue;}
+    double np = patterns[q].rows.n_elem;
+    arma::vec so = s[q](oblk[q]);
+    C(o[q], o[q]) += S[q](oblk[q], oblk[q]);
+    if(nv[q].is_empty()){continue;}
+    arma::vec mn = mu(nv[q]);
+    C(nv[q], o[q]) += mn * so.t();
+    C(o[q], nv[q]) += so * mn.t();
+    C(nv[q], nv[q]) += np * mn * mn.t();
+  }
+  arma::mat oldSigma = C / n;
+  arma::mat Sigma = oldSigma;
+  double diff = 1;
+  int it = 1;
+  while (diff>0.001 && it < maxit){
+    arma::mat bias = arma::zeros<arma::mat>(p,p);
+    C = C0;
+    for (size_t q=0; q<P; ++q){
+      if(o[q].is_empty()){continue;}
+      arma::mat Soo = S[q](oblk[q], oblk[q]);
+      C(o[q], o[q]) += Soo;
+      if(nv[q].is_empty()){continue;}
+      double np = patterns[q].rows.n_elem;
+      arma::mat K = Sigma(nv[q], o[q]) * Sigma(o[q], o[q]).i();
+      bias(nv[q], nv[q]) += np*(Sigma(nv[q], nv[q]) - K * Sigma(o[q], nv[q]));
+      arma::mat KS = K * Soo;
+      C(nv[q], o[q]) += KS;
+      C(o[q], nv[q]) += KS.t();
+      C(nv[q], nv[q]) += KS * K.t();
+    }
+    Sigma = (C + bias)/n;
+    arma::mat diffmat = (Sigma-oldSigma);
+    arma::mat diffsq = diffmat%diffmat;
+    diff = accu(diffsq);
+    oldSigma = Sigma;
+    it = it + 1;
+  }
+  arma::mat finalSigma = arma::zeros<arma::mat>(orig_p, orig_p);
+  finalSigma.submat(valid_ind, valid_ind) = Sigma;
+  return finalSigma;
+}
+
+double get_sigmabeta_from_h(double h,
+                            const arma::vec& gam,
+                            const arma::vec& sigdiag,
+                            const arma::vec& X){
+  //convert h to sigmabeta conditioning on gamma and Sigma
+  int n = X.n_elem;
+  const arma::vec& ds = sigdiag;
+  double num = h * sum(ds);
+  arma::uvec ind = find(gam == 1);
+  double denom = (1-h)*sum(ds(ind)) * sum(X%X)/n;
+  return num/denom;
+}
+
+double get_h_from_sigmabeta(const arma::vec& X, double sigmabeta,
+                            const arma::vec& sigdiag, const arma::vec& gam,
+                            int n){
+  //converts sigmabeta to h conditioning on gamma and Sigma
+  arma::uvec ind = find(gam==1);
+  const arma::vec& ds = sigdiag;
+  double num = sum(X%X)/n * sum(ds(ind)) * sigmabeta;
+  double denom = num + sum(ds);
+  return num/denom;
+}
+
+double log_gamma_prior(int s, int T){
+  //log B(s+1, T-s+1), in log space so that it stays finite for large T
+  return std::lgamma(s+1.0) + std::lgamma(T-s+1.0) - std::lgamma(T+2.0);
+}
+
+arma::vec target_parts(double L, double sigmabeta, const arma::vec& sigdiag,
+                       const arma::vec& gam, const arma::vec& beta){
+  double B = 0;
+  int s = 0;
+  for (arma::uword t=0; t<gam.n_elem; ++t){
+    if(gam(t)==1){
+      B += log_dnorm(beta(t), 0, std::sqrt(sigmabeta*sigdiag(t)));
+      ++s;
+    }
+  }
+  arma::vec out(3);
+  out(0) = L;
+  out(1) = B;
+  out(2) = log_gamma_prior(s, gam.n_elem);
+  return out;
+}
+
+double prior_pair_delta(double sigmabeta, const arma::vec& sigdiag,
+                        const arma::vec& gam1, const arma::vec& beta1,
+                        const arma::vec& gam2, const arma::vec& beta2,
+                        int i, int j){
+  //beta prior on the two coordinates, gamma prior through the model size
+  double dB = 0;
+  int ds = 0;
+  const int changed[2] = {i, j};
+  for (int k=0; k<2; ++k){
+    int t = changed[k];
+    double sd = std::sqrt(sigmabeta*sigdiag(t));
+    if(gam2(t)==1){dB += log_dnorm(beta2(t), 0, sd); ++ds;}
+    if(gam1(t)==1){dB -= log_dnorm(beta1(t), 0, sd); --ds;}
+  }
+  int T = gam1.n_elem;
+  int s = 0;
+  for (int t=0; t<T; ++t){s += (gam1(t)==1);}
+  return dB + log_gamma_prior(s+ds, T) - log_gamma_prior(s, T);
+}
+
+template<typename eT>
+arma::vec get_target(const arma::vec& X, const arma::Mat<eT>& Y, double sigmabeta,
+                     const arma::mat& Sigma, const arma::vec& gam,
+                     const arma::vec& beta){
+  //get the target likelihood circumventing the missing value issue; each
+  //row is widened to double before the density
+  int T = Y.n_cols;
+  int n = Y.n_rows;
+  double L = 0;
+  double B = 0;
+  double G = 0;
+  for (int i=0; i < n; ++i){
+    arma::uvec naind = find_finite(Y.row(i).t());
+    if(naind.n_elem>0){
+      arma::rowvec Ytemp(naind.n_elem);
+      for (arma::uword k=0; k<naind.n_elem; ++k){
+        Ytemp(k) = Y(i, naind(k));
+      }
+      L = L + dmvnrm(Ytemp,
+                     X(i)*beta(naind).t(),
+                     Sigma(naind,naind),
+                     true);
+    }
+  }
+  arma::uvec ind = find(gam==1);
+  int s = ind.n_elem;
+  if(s>0){
+    arma::vec ds = Sigma.diag();
+    for (int j=0; j<s; ++j){
+      int newind = ind(j);
+      B = B + log_dnorm(beta(newind), 0, std::sqrt(sigmabeta*ds(newind)));
+    }
+  }
+  G = log_gamma_prior(s, T);
+  arma::vec out = arma::zeros<arma::vec>(3);
+  out(0) = L;
+  out(1) = B;
+  out(2) = G;
+  return out;
+}
+
+double likelihood_quadratic(const std::vector<Pattern>& patterns,
+                            const arma::mat& Sigma, BetaQuadratic& q){
+  //per pattern, with P = Sigma_oo^-1, the rows contribute
+  //-(tr(P syy) - 2 beta_o'P sxy + sxx beta_o'P beta_o)/2 -
+  //rows (|o| log 2pi + log|Sigma_oo|)/2
+  int T = Sigma.n_rows;
+  q.H = arma::zeros<arma::mat>(T,T);
+  q.g = arma::zeros<arma::vec>(T);
+  double c = 0;
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    if(pat.syy.is_empty()){
+      throw std::runtime_error("likelihood_quadratic: syy not filled (fill_syy)");
+    }
+    arma::mat R;
+    if(!arma::chol(R, arma::mat(Sigma(pat.obs, pat.obs)))){
+      throw std::runtime_error("get_target: Sigma is not positive definite");
+    }
+    arma::mat Ri = arma::inv(arma::trimatu(R));
+    arma::mat P = Ri * Ri.t();
+    q.H(pat.obs, pat.obs) += pat.sxx * P;
+    q.g(pat.obs) += P * pat.sxy;
+    c -= 0.5*(arma::accu(P % pat.syy) + pat.rows.n_elem *
+              (pat.obs.n_elem*log2pi + 2*arma::accu(arma::log(R.diag()))));
+  }
+  return c;
+}
+
+template<typename eT>
+DenseTarget<eT>::DenseTarget(const arma::vec& X, const arma::Mat<eT>& Y,
+                             double sigmabeta, const arma::mat& Sigma)
+  : X(&X), Y(&Y), patterns(0), Yp(0), sigmabeta(sigmabeta), Sigma(Sigma),
+    sigdiag(Sigma.diag()), suffstat(false), c(0) {}
+
+template<typename eT>
+DenseTarget<eT>::DenseTarget(const std::vector<Pattern>& patterns,
+                             const std::vector<arma::Mat<eT> >& Yp,
+                             double sigmabeta, const arma::mat& Sigma,
+                             LikelihoodKernel kernel, bool quadratic)
+  : X(0), Y(0), patterns(&patterns), Yp(&Yp), sigmabeta(sigmabeta),
+    Sigma(Sigma), sigdiag(Sigma.diag()), suffstat(kernel == KERNEL_SUFFSTAT),
+    c(0) {
+  if(suffstat){
+    c = likelihood_quadratic(patterns, Sigma, q);
+    return;
+  }
+  //the row kernel on float values would not match the double form
+  if(quadratic && sizeof(eT) == sizeof(double)){
+    q = beta_quadratic(patterns, Sigma);
+  }
+  if(fixed_t_supported(Sigma.n_rows)){return;}
+  Rinv.resize(patterns.size());
+  logdet.set_size(patterns.size());
+  for (size_t p=0; p<patterns.size(); ++p){
+    const arma::uvec& obs = patterns[p].obs;
+    arma::mat R;
+    if(!arma::chol(R, arma::mat(Sigma(obs, obs)))){
+      throw std::runtime_error("get_target: Sigma is not positive definite");
+    }
+    Rinv[p] = arma::inv(arma::trimatu(R));
+    logdet(p) = 2*arma::accu(arma::log(R.diag()));
+  }
+}
+
+template<typename eT>
+arma::vec DenseTarget<eT>::eval(const arma::vec& gam, const arma::vec& beta,
+                                Arena& arena) const {
+  if(!patterns){
+    return get_target(*X, *Y, sigmabeta, Sigma, gam, beta);
+  }
+  if(suffstat){
+    //c + sum_j beta_j (g_j - (H beta)_j/2), skipping the zero coordinates
+    int T = Sigma.n_rows;
+    double L = c;
+    for (int j=0; j<T; ++j){
+      if(beta(j) == 0){continue;}
+      const double* h = q.H.colptr(j);
+      double hb = 0;
+      for (int i=0; i<T; ++i){hb += h[i]*beta(i);}
+      L += beta(j)*(q.g(j) - 0.5*hb);
+    }
+    return target_parts(L, sigmabeta, sigdiag, gam, beta);
+  }
+  if(fixed_t_supported(Sigma.n_rows)){
+    return get_target_fixed(*patterns, *Yp, sigmabeta, Sigma, gam, beta);
+  }
+  //|Rinv' r|^2 per row, residuals in arena buffers
+  int T = Sigma.n_rows;
+  arena.reset();
+  arena.reserve(2*T);
+  double* b = arena.take(T);
+  double* r = arena.take(T);
+  double L = 0;
+  for (size_t p=0; p<patterns->size(); ++p){
+    const Pattern& pat = (*patterns)[p];
+    const arma::mat& Ri = Rinv[p];
+    const arma::Mat<eT>& y = (*Yp)[p];
+    int m = pat.obs.n_elem;
+    for (int j=0; j<m; ++j){b[j] = beta(pat.obs(j));}
+    double quad = 0;
+    for (arma::uword k=0; k<pat.rows.n_elem; ++k){
+      const eT* yk = y.colptr(k);
+      double x = pat.x(k);
+      for (int j=0; j<m; ++j){r[j] = yk[j] - x*b[j];}
+      for (int j=0; j<m; ++j){
+        const double* col = Ri.colptr(j);
+        double z = 0;
+        for (int l=0; l<=j; ++l){z += col[l]*r[l];}
+        quad += z*z;
+      }
+    }
+    L -= 0.5*quad + pat.rows.n_elem*(0.5*m*log2pi + 0.5*logdet(p));
+  }
+  return target_parts(L, sigmabeta, sigdiag, gam, beta);
+}
+
+template<typename eT>
+double DenseTarget<eT>::pair_delta(const arma::vec& gam1, const arma::vec& beta1,
+                                   double cur, const arma::vec& gam2,
+                                   const arma::vec& beta2, int i, int j,
+                                   Arena& arena) const {
+  if(q.H.is_empty()){
+    return Target::pair_delta(gam1, beta1, cur, gam2, beta2, i, j, arena);
+  }
+  //with d = beta2 - beta1, zero outside i != j, the likelihood changes by
+  //g'd - beta1'H d - d'H d/2
+  const arma::mat& H = q.H;
+  double di = beta2(i)-beta1(i);
+  double dj = beta2(j)-beta1(j);
+  double dL = q.g(i)*di + q.g(j)*dj -
+    di*arma::dot(H.col(i), beta1) - dj*arma::dot(H.col(j), beta1) -
+    0.5*(di*di*H(i,i) + 2*di*dj*H(i,j) + dj*dj*H(j,j));
+  return dL + prior_pair_delta(sigmabeta, sigdiag, gam1, beta1, gam2, beta2,
+                               i, j);
+}
+
+DiagonalTarget::DiagonalTarget(const std::vector<Pattern>& patterns,
+                               double sigmabeta, const arma::vec& sigdiag)
+  : sigmabeta(sigmabeta), sigdiag(sigdiag),
+    sxx(sigdiag.n_elem, arma::fill::zeros),
+    sxy(sigdiag.n_elem, arma::fill::zeros) {
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    for (arma::uword j=0; j<pat.obs.n_elem; ++j){
+      sxx(pat.obs(j)) += pat.sxx;
+      sxy(pat.obs(j)) += pat.sxy(j);
+    }
+  }
+}
+
+arma::vec DiagonalTarget::eval(const arma::vec& gam, const arma::vec& beta,
+                               Arena&) const {
+  //sum_t (beta_t sxy_t - beta_t^2 sxx_t/2)/Sigma_tt, dropping the terms
+  //that do not involve beta
+  double L = 0;
+  for (arma::uword t=0; t<beta.n_elem; ++t){
+    if(beta(t) != 0){
+      L += beta(t)*(sxy(t) - 0.5*beta(t)*sxx(t))/sigdiag(t);
+    }
+  }
+  return target_parts(L, sigmabeta, sigdiag, gam, beta);
+}
+
+static void perturb_active(Rng& rng, const arma::vec& beta1,
+                           const arma::vec& gam2, const arma::vec& sd,
+                           arma::vec& beta2){
+  //beta2 = beta1 on the active set of gam2 plus N(0, sd(t)^2) noise, 0 elsewhere
+  beta2.set_size(beta1.n_elem);
+  for (arma::uword t=0; t<beta1.n_elem; ++t){
+    beta2(t) = (gam2(t)==1) ? beta1(t) + sd(t)*rng.norm() : 0;
+  }
+}
+
+static void adapt_scale(ProposalScale& scale, const arma::vec& gam2, double logA){
+  //Robbins-Monro step on the log scale of every coordinate the regular move
+  //perturbed, with step size n^-0.6 in that coordinate's adaptation count
+  double alpha = (logA >= 0) ? 1 : std::exp(logA);
+  if(!arma::is_finite(alpha)){alpha = 0;}
+  for (arma::uword t=0; t<gam2.n_elem; ++t){
+    if(gam2(t)==1){
+      scale.nadapt(t)++;
+      scale.logsd(t) += std::pow(static_cast<double>(scale.nadapt(t)), -0.6) *
+        (alpha - scale.target);
+    }
+  }
+}
+
+GammaProposal update_gamma(Rng& rng, const arma::vec& X, const arma::mat& Y,
+                           const arma::vec& gam){
+  //update gamma once
+  GammaProposal out;
+  out.gam = gam;
+  out.changeind = 0;
+  int T = gam.n_elem;
+  arma::uvec ind0 = find(gam==0);
+  arma::uvec ind1 = find(gam==1);
+  int s = ind1.n_elem;
+  int cas = (rng.unif() < 0.5) ? 1 : 2;
+  if(s==0){
+    cas = 1;
+  }else if(s==T){
+    cas = 2;
+  }
+  if (cas==1){
+    arma::vec marcor(ind0.n_elem);
+    for (arma::uword t=0; t<ind0.n_elem; ++t){
+      marcor(t) = std::abs(marginal_cor_col(X, Y, ind0(t)));
+    }
+    int add = 0;
+    if(s<(T-1)){
+      add = sample_index(rng, marcor);
+    }
+    out.gam(ind0(add)) = 1;
+    out.changeind = ind0(add);
+  }else{
+    int remove = ind1(sample_uniform(rng, s));
+    out.gam(remove) = 0;
+    out.changeind = remove;
+  }
+  return out;
+}
+
+arma::vec betagam_accept(const arma::vec& X,
+                         const arma::mat& Y,
+                         double sigmabeta1,
+                         const arma::mat& inputSigma,
+                         double Vbeta,
+                         const arma::vec& gam1,
+                         const arma::vec& beta1,
+                         const arma::vec& gam2,
+                         const arma::vec& beta2,
+                         int changeind,
+                         int change){
+  //compute the target likelihood and the proposal ratio
+  //to decide if you should accept the proposed beta and gamma
+  double newtarget = sum(get_target(X,Y,sigmabeta1,inputSigma,gam2,beta2));
+  double oldtarget = sum(get_target(X,Y,sigmabeta1,inputSigma,gam1,beta1));
+  double proposal_ratio = log_dnorm(beta1(changeind)-beta2(changeind),0,std::sqrt(Vbeta));
+  int s1 = arma::accu(gam1==1);
+  int s2 = arma::accu(gam2==1);
+  arma::rowvec marcor = arma::abs(marginal_cor(X, Y));
+  if(change==1){
+    arma::uvec ind1 = find(gam1==0);
+    double temp1 = marcor(changeind)/sum(marcor(ind1));
+    proposal_ratio = -std::log(temp1)-std::log(s2)-proposal_ratio;
+  }else{
+    arma::uvec ind2 = find(gam2==0);
+    double temp2 = marcor(changeind)/sum(marcor(ind2));
+    proposal_ratio = std::log(temp2)+std::log(s1)+proposal_ratio;
+  }
+  double final_ratio = newtarget-oldtarget+proposal_ratio;
+  arma::vec out = arma::zeros<arma::vec>(4);
+  out(0) = final_ratio;
+  out(1) = newtarget;
+  out(2) = oldtarget;
+  out(3) = proposal_ratio;
+  return(out);
+}
+
+BetaGam update_betagam(Rng& rng,
+                       const arma::vec& X,
+                       const arma::mat& Y,
+                       arma::vec gam1,
+                       arma::vec beta1,
+                       const arma::mat& Sigma,
+                       double sigmabeta,
+                       double Vbeta,
+                       int bgiter){
+  //update and beta and gamma 'bgiter' times
+  arma::vec sdbeta(gam1.n_elem);
+  sdbeta.fill(std::sqrt(Vbeta));
+  arma::vec beta2;
+  for (int i=1; i<bgiter; ++i){
+    GammaProposal temp = update_gamma(rng,X,Y,gam1);
+    perturb_active(rng, beta1, temp.gam, sdbeta, beta2);
+    int changeind = temp.changeind;
+    int change = temp.gam(changeind);
+    arma::vec A = betagam_accept(X,Y,sigmabeta,
+                                 Sigma,Vbeta,
+                                 gam1,beta1,
+                                 temp.gam,beta2,
+                                 changeind,change);
+    double check = rng.unif();
+    if(std::exp(A(0))>check){
+      gam1 = temp.gam; beta1 = beta2;
+    }
+  }
+  BetaGam out;
+  out.gam = gam1;
+  out.beta = beta1;
+  return out;
+}
+
+HSigma update_h(Rng& rng, double initialh, int hiter, const arma::vec& gam,
+                const arma::vec& beta, const arma::vec& sigdiag,
+                const arma::vec& X){
+  double h1 = initialh;
+  double sigbeta1 = get_sigmabeta_from_h(initialh, gam, sigdiag, X);
+  const arma::vec& ds = sigdiag;
+  arma::uvec ind = find(gam==1);
+  for (int i=1; i<hiter; ++i){
+    double h2 = h1;
+    double r = -0.1 + 0.2*rng.unif();
+    h2 = h2 + r;
+    if(h2<0){h2 = std::abs(h2);}
+    if(h2>1){h2 = 2-h2;}
+    double sigmabeta1 = get_sigmabeta_from_h(h1, gam, sigdiag, X);
+    double sigmabeta2 = get_sigmabeta_from_h(h2, gam, sigdiag, X);
+    double lik1 = 0; double lik2 = 0;
+    for (arma::uword j=0; j < ind.n_elem; ++j){
+      int newind = ind(j);
+      lik1 = lik1 + log_dnorm(beta(newind), 0, std::sqrt(sigmabeta1*ds(newind)));
+      lik2 = lik2 + log_dnorm(beta(newind), 0, std::sqrt(sigmabeta2*ds(newind)));
+    }
+    double acceptanceprob = std::exp(lik2-lik1);
+    double e = rng.unif();
+    if(e<acceptanceprob){
+      h1 = h2; sigbeta1 = sigmabeta2;
+    }
+  }
+  HSigma out;
+  out.h = h1;
+  out.sigbeta = sigbeta1;
+  return out;
+}
+
+template<typename eT>
+arma::mat update_Sigma(Rng& rng, int n, int nu, const arma::vec& X,
+                       const arma::vec& beta, const arma::mat& Phi,
+                       const arma::Mat<eT>& Y){
+  //residuals are kept in Y's precision
+  arma::Mat<eT> r(Y.n_rows, Y.n_cols);
+  for (arma::uword t=0; t<Y.n_cols; ++t){
+    for (arma::uword i=0; i<Y.n_rows; ++i){
+      r(i,t) = static_cast<eT>(Y(i,t) - X(i)*beta(t));
+    }
+  }
+  arma::mat emp = em_with_zero_mean(r,100);
+  arma::cube res = rinvwish(rng, 1, n+nu, emp*n + Phi*nu);
+  return res.slice(0);
+}
+
+template<typename eT>
+arma::mat update_Sigma(Rng& rng, int n, int nu,
+                       const std::vector<Pattern>& patterns,
+                       const std::vector<arma::Mat<eT> >& Yp,
+                       const arma::vec& beta, const arma::mat& Phi){
+  arma::mat emp = em_with_zero_mean(patterns, Yp, beta, n, 100);
+  arma::cube res = rinvwish(rng, 1, n+nu, emp*n + Phi*nu);
+  return res.slice(0);
+}
+
+arma::rowvec flip_marcor(const arma::rowvec& marcor){
+  //removal weights of the small-world sampler: small for strongly marginally
+  //correlated traits, never zero
+  return max(marcor) - marcor + 0.01;
+}
+
+static double masked_sum(const arma::rowvec& v, const arma::vec& gam, double value){
+  double s = 0;
+  for (arma::uword t=0; t<v.n_elem; ++t){
+    if(gam(t)==value){s += v(t);}
+  }
+  return s;
+}
+
+double sw_proposal_ratio(const arma::rowvec& marcor, const arma::rowvec& marcor2,
+                         const arma::vec& gam1, const arma::vec& gam2,
+                         double dbeta, int changeind, int change){
+  //log q(2->1) - log q(1->2) of one update_gamma_sw move; dbeta is the log
+  //density of the beta coordinate that was added or dropped
+  if(change==1){
+    double tempadd = marcor(changeind)/masked_sum(marcor, gam1, 0);
+    double tempremove = marcor2(changeind)/masked_sum(marcor2, gam2, 1);
+    return -std::log(tempadd)+std::log(tempremove)-dbeta;
+  }
+  double tempadd = marcor(changeind)/masked_sum(marcor, gam2, 0);
+  double tempremove = marcor2(changeind)/masked_sum(marcor2, gam1, 1);
+  return std::log(tempadd)-std::log(tempremove)+dbeta;
+}
+
+static double propose_swap(Rng& rng, const arma::vec& gam,
+                           const arma::rowvec& marcor,
+                           const arma::rowvec& marcor2, Workspace& ws,
+                           int& drop, int& add){
+  //drop an active trait in proportion to marcor2 and add an inactive one in
+  //proportion to marcor; returns log q(2->1) - log q(1->2) of the two picks
+  int T = gam.n_elem;
+  ws.reserve(T);
+  int m = 0;
+  for (int t=0; t<T; ++t){
+    if(gam(t)==1){ws.idx(m) = t; ws.weight(m) = marcor2(t); ++m;}
+  }
+  drop = ws.idx(sample_index(rng, ws.weight.memptr(), m));
+  m = 0;
+  for (int t=0; t<T; ++t){
+    if(gam(t)==0){ws.idx(m) = t; ws.weight(m) = marcor(t); ++m;}
+  }
+  add = ws.idx(sample_index(rng, ws.weight.memptr(), m));
+  double active = masked_sum(marcor2, gam, 1);
+  double inactive = masked_sum(marcor, gam, 0);
+  double fwd = std::log(marcor2(drop)/active) + std::log(marcor(add)/inactive);
+  double rev = std::log(marcor2(add)/(active - marcor2(drop) + marcor2(add))) +
+    std::log(marcor(drop)/(inactive - marcor(add) + marcor(drop)));
+  return rev - fwd;
+}
+
+int propose_gamma_sw(Rng& rng, const arma::vec& gam, const arma::rowvec& marcor,
+                     const arma::rowvec& marcor2, Workspace& ws,
+                     arma::vec& gam2){
+  //add a trait with probability proportional to marcor or drop one in
+  //proportion to marcor2, each with probability 1/2
+  int T = gam.n_elem;
+  ws.reserve(T);
+  gam2 = gam;
+  int s = 0;
+  for (int t=0; t<T; ++t){s += (gam(t)==1);}
+  int cas = (rng.unif() < 0.5) ? 1 : 2;
+  if(s==0){
+    cas = 1;
+  }else if(s==T){
+    cas = 2;
+  }
+  //candidates in increasing order, as find() would give them
+  double from = (cas==1) ? 0 : 1;
+  const arma::rowvec& w = (cas==1) ? marcor : marcor2;
+  int m = 0;
+  for (int t=0; t<T; ++t){
+    if(gam(t)==from){
+      ws.idx(m) = t;
+      ws.weight(m) = w(t);
+      ++m;
+    }
+  }
+  int pick = 0;
+  if((cas==1 && s<(T-1)) || (cas==2 && s>1)){
+    pick = sample_index(rng, ws.weight.memptr(), m);
+  }
+  int changeind = ws.idx(pick);
+  gam2(changeind) = 1-from;
+  return changeind;
+}
+
+GammaProposal update_gamma_sw(Rng& rng, const arma::vec& gam,
+                              const arma::rowvec& marcor){
+  Workspace ws;
+  GammaProposal out;
+  out.changeind = propose_gamma_sw(rng, gam, marcor, flip_marcor(marcor), ws,
+                                   out.gam);
+  return out;
+}
+
+arma::vec betagam_accept_sw(const arma::vec& X,
+                            const arma::mat& Y,
+                            double sigmabeta1,
+                            const arma::mat& inputSigma,
+                            double Vbeta,
+                            const arma::vec& gam1,
+                            const arma::vec& beta1,
+                            const arma::vec& gam2,
+                            const arma::vec& beta2,
+                            int changeind,
+                            int change){
+  return betagam_accept_sw(X, Y, sigmabeta1, inputSigma, Vbeta,
+                           arma::abs(marginal_cor(X, Y)), gam1, beta1,
+                           gam2, beta2, changeind, change);
+}
+
+template<typename eT>
+arma::vec betagam_accept_sw(const arma::vec& X,
+                            const arma::Mat<eT>& Y,
+                            double sigmabeta1,
+                            const arma::mat& inputSigma,
+                            double Vbeta,
+                            const arma::rowvec& marcor,
+                            const arma::vec& gam1,
+                            const arma::vec& beta1,
+                            const arma::vec& gam2,
+                            const arma::vec& beta2,
+                            int changeind,
+                            int change){
+  //marcor = |marginal_cor(X, Y)|, precomputed by the caller
+  double newtarget = sum(get_target(X,Y,sigmabeta1,inputSigma,gam2,beta2));
+  double oldtarget = sum(get_target(X,Y,sigmabeta1,inputSigma,gam1,beta1));
+  double dbeta = log_dnorm(beta1(changeind)-beta2(changeind),0,std::sqrt(Vbeta));
+  double proposal_ratio = sw_proposal_ratio(marcor, flip_marcor(marcor),
+                                            gam1, gam2, dbeta,
+                                            changeind, change);
+  double final_ratio = newtarget-oldtarget+proposal_ratio;
+  arma::vec out = arma::zeros<arma::vec>(4);
+  out(0) = final_ratio;
+  out(1) = newtarget;
+  out(2) = oldtarget;
+  out(3) = proposal_ratio;
+  return(out);
+}
+
+BetaGam update_betagam_sw(Rng& rng,
+                          const Target& target,
+                          const arma::rowvec& marcor,
+                          const arma::vec& gam0,
+                          const arma::vec& beta0,
+                          ProposalScale& scale,
+                          Workspace& ws,
+                          int bgiter,
+                          int smallworlditer,
+                          double invtemp,
+                          const Target* surrogate,
+                          double swapprob,
+                          int offset,
+                          double logtarget){
+  //invtemp < 1 samples from the target raised to the power invtemp. The
+  //target of the current state is carried along, so every step costs a
+  //single evaluation; proposals are built in the workspace's buffers.
+  //With a surrogate (delayed acceptance) a proposal is first tested on the
+  //surrogate and only survivors cost a target evaluation; the second test
+  //uses (target ratio)/(surrogate ratio), as in Christen & Fox (2005).
+  //With probability swapprob a regular step is instead a swap of one
+  //active and one inactive trait, priced by Target::pair_delta().
+  int T = gam0.n_elem;
+  ws.reserve(T);
+  arma::vec& sdbeta = ws.sdbeta;
+  sdbeta = arma::exp(scale.logsd);
+  ws.marcor2 = flip_marcor(marcor);
+  arma::vec gam1 = gam0;
+  arma::vec beta1 = beta0;
+  double cur = std::isnan(logtarget) ? target(gam1, beta1, ws.arena) : logtarget;
+  double curs = surrogate ? (*surrogate)(gam1, beta1, ws.arena) : 0;
+  arma::vec tar = arma::zeros<arma::vec>(bgiter);
+  tar(0) = cur;
+  for (int i=1; i<bgiter; ++i){
+    //small world proposal: chain smallworlditer single moves and
+    //accept or reject the composite move as a whole
+    if((offset+i)%10==0){
+      double proposal_ratio = 0;
+      ws.gamsw = gam1;
+      ws.betasw = beta1;
+      for (int j=0; j < smallworlditer; ++j){
+        int changeind = propose_gamma_sw(rng, ws.gamsw, marcor, ws.marcor2, ws,
+                                         ws.gam2);
+        perturb_active(rng, ws.betasw, ws.gam2, sdbeta, ws.betasw2);
+        int change = ws.gam2(changeind);
+        double dbeta = log_dnorm(ws.betasw(changeind)-ws.betasw2(changeind),
+                                 0, sdbeta(changeind));
+        proposal_ratio += sw_proposal_ratio(marcor, ws.marcor2, ws.gamsw,
+                                            ws.gam2, dbeta, changeind, change);
+        ws.gamsw.swap(ws.gam2);
+        ws.betasw.swap(ws.betasw2);
+      }
+      double newtarget = 0, news = 0;
+      bool accept;
+      if(surrogate){
+        news = (*surrogate)(ws.gamsw, ws.betasw, ws.arena);
+        accept = std::exp(invtemp*(news-curs) + proposal_ratio) > rng.unif();
+        if(accept){
+          newtarget = target(ws.gamsw, ws.betasw, ws.arena);
+          accept = std::exp(invtemp*((newtarget-cur)-(news-curs))) > rng.unif();
+        }else{
+          scale.screened(1)++;
+        }
+      }else{
+        newtarget = target(ws.gamsw, ws.betasw, ws.arena);
+        double A = invtemp*(newtarget-cur) + proposal_ratio;
+        double check = rng.unif();
+        accept = std::exp(A) > check;
+      }
+      scale.proposed(1)++;
+      if(accept){
+        scale.accepted(1)++;
+        gam1.swap(ws.gamsw); beta1.swap(ws.betasw); cur = newtarget;
+        curs = news;
+      }
+    }else if(swapprob > 0 && rng.unif() < swapprob &&
+             arma::accu(gam1) > 0 && arma::accu(gam1) < T){
+      //drop one trait and add another with a fresh N(0, sd^2) coefficient;
+      //the other coordinates are untouched, so the target moves by a
+      //two-coordinate update where the target has one
+      int drop, add;
+      double logq = propose_swap(rng, gam1, marcor, ws.marcor2, ws, drop, add);
+      ws.gam2 = gam1;
+      ws.beta2 = beta1;
+      ws.gam2(drop) = 0; ws.beta2(drop) = 0;
+      ws.gam2(add) = 1; ws.beta2(add) = sdbeta(add)*rng.norm();
+      logq += log_dnorm(beta1(drop), 0, sdbeta(drop)) -
+        log_dnorm(ws.beta2(add), 0, sdbeta(add));
+      double delta = target.pair_delta(gam1, beta1, cur, ws.gam2, ws.beta2,
+                                       drop, add, ws.arena);
+      scale.proposed(3)++;
+      if(std::exp(invtemp*delta + logq) > rng.unif()){
+        scale.accepted(3)++;
+        gam1.swap(ws.gam2); beta1.swap(ws.beta2); cur += delta;
+        if(surrogate){curs = (*surrogate)(gam1, beta1, ws.arena);}
+      }
+    }else{
+      int changeind = propose_gamma_sw(rng, gam1, marcor, ws.marcor2, ws,
+                                       ws.gam2);
+      perturb_active(rng, beta1, ws.gam2, sdbeta, ws.beta2);
+      int change = ws.gam2(changeind);
+      double newtarget = 0, news = 0, logA;
+      bool accept;
+      if(surrogate){
+        //adaptation sees the first-stage probability alone when the
+        //second stage is skipped
+        news = (*surrogate)(ws.gam2, ws.beta2, ws.arena);
+        double dbeta = log_dnorm(beta1(changeind)-ws.beta2(changeind),
+                                 0, sdbeta(changeind));
+        logA = invtemp*(news-curs) +
+          sw_proposal_ratio(marcor, ws.marcor2, gam1, ws.gam2, dbeta,
+                            changeind, change);
+        accept = std::exp(logA) > rng.unif();
+        if(accept){
+          newtarget = target(ws.gam2, ws.beta2, ws.arena);
+          double logA2 = invtemp*((newtarget-cur)-(news-curs));
+          accept = std::exp(logA2) > rng.unif();
+          logA = ((logA >= 0) ? 0 : logA) + ((logA2 >= 0) ? 0 : logA2);
+        }else{
+          scale.screened(0)++;
+        }
+      }else{
+        newtarget = target(ws.gam2, ws.beta2, ws.arena);
+        double dbeta = log_dnorm(beta1(changeind)-ws.beta2(changeind),
+                                 0, sdbeta(changeind));
+        logA = invtemp*(newtarget-cur) +
+          sw_proposal_ratio(marcor, ws.marcor2, gam1, ws.gam2, dbeta,
+                            changeind, change);
+        double check = rng.unif();
+        accept = std::exp(logA)>check;
+      }
+      scale.proposed(0)++;
+      if(scale.adapt){
+        adapt_scale(scale, ws.gam2, logA);
+        sdbeta = arma::exp(scale.logsd);
+      }
+      if(accept){
+        scale.accepted(0)++;
+        gam1.swap(ws.gam2); beta1.swap(ws.beta2); cur = newtarget;
+        curs = news;
+      }
+    }
+    tar(i) = cur;
+  }
+  BetaGam out;
+  out.gam = gam1;
+  out.beta = beta1;
+  out.tar = tar;
+  return out;
+}
+
+template<typename eT>
+BetaGam update_betagam_sw(Rng& rng,
+                          const arma::vec& X,
+                          const arma::Mat<eT>& Y,
+                          const arma::vec& gam0,
+                          const arma::vec& beta0,
+                          const arma::mat& Sigma,
+                          const arma::rowvec& marcor,
+                          double sigmabeta,
+                          ProposalScale& scale,
+                          int bgiter,
+                          int smallworlditer,
+                          double invtemp,
+                          int offset){
+  DenseTarget<eT> target(X, Y, sigmabeta, Sigma);
+  Workspace ws;
+  return update_betagam_sw(rng, target, marcor, gam0, beta0, scale, ws, bgiter,
+                           smallworlditer, invtemp, 0, 0, offset);
+}
+
+BetaGam update_betagam_sw(Rng& rng,
+                          const arma::vec& X,
+                          const arma::mat& Y,
+                          const arma::vec& gam0,
+                          const arma::vec& beta0,
+                          const arma::mat& Sigma,
+                          const arma::rowvec& marcor,
+                          double sigmabeta,
+                          double Vbeta,
+                          int bgiter,
+                          int smallworlditer,
+                          double invtemp,
+                          int offset){
+  //fixed proposal scale sqrt(Vbeta) on every coordinate
+  ProposalScale scale(gam0.n_elem, Vbeta, false);
+  return update_betagam_sw(rng, X, Y, gam0, beta0, Sigma, marcor, sigmabeta,
+                           scale, bgiter, smallworlditer, invtemp, offset);
+}
+
+static void update_betagam_state(Rng& rng, const Data& data,
+                                 const Target& target, const arma::vec& sigdiag,
+                                 const SamplerOptions& opt, ChainState& state){
+  //the surrogate shares Sigma's diagonal with the target
+  DiagonalTarget diag(data.patterns, state.sigmabeta, sigdiag);
+  const Target* surrogate = opt.delayed ? &diag : 0;
+  if(state.pt.invtemp.n_elem > 1){
+    update_betagam_pt(rng, target, data.marcor, opt, state.pt, surrogate);
+    state.gam = state.pt.gam[0];
+    state.beta = state.pt.beta[0];
+  }else{
+    BetaGam bg = update_betagam_sw(rng, target, data.marcor, state.gam,
+                                   state.beta, state.scale, state.ws,
+                                   opt.bgiter, opt.switer, 1.0, surrogate,
+                                   opt.swapprob);
+    state.gam = bg.gam;
+    state.beta = bg.beta;
+  }
+}
+
+template<typename eT>
+static void outer_iteration_impl(Rng& rng, const Data& data,
+                                 const std::vector<arma::Mat<eT> >& Yp,
+                                 const arma::mat& Phi,
+                                 int nu, double Vbeta, const SamplerOptions& opt,
+                                 ChainState& state){
+  const arma::vec& X = data.X;
+  bool factor = state.fac.Lambda.n_cols > 0;
+  if(factor && opt.malaiter > 0){
+    throw std::invalid_argument("the MALA beta update needs a dense Sigma");
+  }
+  //run_two_chains() fixes the kernel once; direct callers get the cost model
+  LikelihoodKernel kernel = opt.kernel;
+  if(!factor && kernel == KERNEL_AUTO){
+    kernel = choose_kernel(data, state, opt, false);
+  }
+  if(!factor && kernel == KERNEL_SUFFSTAT){
+    fill_syy(data.patterns, data.Y);
+  }
+  if(state.scale.logsd.is_empty()){
+    state.scale = ProposalScale(data.T, Vbeta, false);
+  }
+  arma::vec sigdiag;
+  if(factor){
+    {
+      FactorTarget<eT> target(data.patterns, Yp, state.sigmabeta, state.fac);
+      update_betagam_state(rng, data, target, state.fac.diag(), opt, state);
+    }
+    update_factor_cov(rng, data.patterns, Yp, state.beta, opt.factor_prior,
+                      state.fac);
+    sigdiag = state.fac.diag();
+  }else{
+    {
+      DenseTarget<eT> target(data.patterns, Yp, state.sigmabeta, state.Sigma,
+                             kernel, opt.swapprob > 0);
+      update_betagam_state(rng, data, target, state.Sigma.diag(), opt, state);
+    }
+    if(opt.malaiter > 0){
+      bool tempered = state.pt.invtemp.n_elem > 1;
+      BetaQuadratic q = beta_quadratic(data.patterns, state.Sigma);
+      update_beta_mala(rng, q, state.Sigma, state.sigmabeta, state.gam,
+                       state.beta, opt.malaiter,
+                       tempered ? state.pt.scale[0] : state.scale);
+      if(tempered){state.pt.beta[0] = state.beta;}
+    }
+    state.Sigma = update_Sigma(rng, data.n, nu, data.patterns, Yp, state.beta,
+                               Phi);
+    sigdiag = state.Sigma.diag();
+  }
+  HSigma hsig = update_h(rng, state.h, opt.hiter, state.gam, state.beta,
+                         sigdiag, X);
+  state.h = hsig.h;
+  state.sigmabeta = hsig.sigbeta;
+  if(!arma::is_finite(state.sigmabeta)){
+    state.sigmabeta = 1000;
+  }
+  if(factor){
+    FactorTarget<eT> target(data.patterns, Yp, state.sigmabeta, state.fac);
+    state.tar = target.components(state.gam, state.beta);
+  }else{
+    DenseTarget<eT> target(data.patterns, Yp, state.sigmabeta, state.Sigma,
+                           kernel);
+    state.tar = target.components(state.gam, state.beta);
+  }
+}
+
+void outer_iteration(Rng& rng, const Data& data, const arma::mat& Phi, int nu,
+                     double Vbeta, const SamplerOptions& opt,
+                     ChainState& state){
+  if(data.single){
+    outer_iteration_impl(rng, data, data.Ypf, Phi, nu, Vbeta, opt, state);
+  }else{
+    outer_iteration_impl(rng, data, data.Yp, Phi, nu, Vbeta, opt, state);
+  }
+}
+
+void freeze_adaptation(ChainState& state){
+  state.scale.adapt = false;
+  state.scale.proposed.zeros();
+  state.scale.accepted.zeros();
+  state.scale.screened.zeros();
+  for (size_t k=0; k<state.pt.scale.size(); ++k){
+    state.pt.scale[k].adapt = false;
+    state.pt.scale[k].proposed.zeros();
+    state.pt.scale[k].accepted.zeros();
+    state.pt.scale[k].screened.zeros();
+  }
+}
+
+const ProposalScale& cold_scale(const ChainState& state){
+  return (state.pt.invtemp.n_elem > 1) ? state.pt.scale[0] : state.scale;
+}
+
+//kernels over Y, for double and single-precision (Data::single) storage
+template class DenseTarget<double>;
+template class DenseTarget<float>;
+template double marginal_cor_col(const arma::vec&, const arma::mat&, arma::uword);
+template double marginal_cor_col(const arma::vec&, const arma::fmat&, arma::uword);
+template arma::rowvec marginal_cor(const arma::vec&, const arma::mat&);
+template arma::rowvec marginal_cor(const arma::vec&, const arma::fmat&);
+template arma::mat em_with_zero_mean(const arma::mat&, int);
+template arma::mat em_with_zero_mean(const arma::fmat&, int);
+template arma::mat em_with_zero_mean(const std::vector<Pattern>&,
+                                     const std::vector<arma::mat>&,
+                                     const arma::vec&, int, int);
+template arma::mat em_with_zero_mean(const std::vector<Pattern>&,
+                                     const std::vector<arma::fmat>&,
+                                     const arma::vec&, int, int);
+template arma::vec get_target(const arma::vec&, const arma::mat&, double,
+                              const arma::mat&, const arma::vec&,
+                              const arma::vec&);
+template arma::vec get_target(const arma::vec&, const arma::fmat&, double,
+                              const arma::mat&, const arma::vec&,
+                              const arma::vec&);
+template arma::mat update_Sigma(Rng&, int, int, const arma::vec&,
+                                const arma::vec&, const arma::mat&,
+                                const arma::mat&);
+template arma::mat update_Sigma(Rng&, int, int, const arma::vec&,
+                                const arma::vec&, const arma::mat&,
+                                const arma::fmat&);
+template arma::mat update_Sigma(Rng&, int, int, const std::vector<Pattern>&,
+                                const std::vector<arma::mat>&,
+                                const arma::vec&, const arma::mat&);
+template arma::mat update_Sigma(Rng&, int, int, const std::vector<Pattern>&,
+                                const std::vector<arma::fmat>&,
+                                const arma::vec&, const arma::mat&);
+template arma::vec betagam_accept_sw(const arma::vec&, const arma::mat&, double,
+                                     const arma::mat&, double,
+                                     const arma::rowvec&, const arma::vec&,
+                                     const arma::vec&, const arma::vec&,
+                                     const arma::vec&, int, int);
+template arma::vec betagam_accept_sw(const arma::vec&, const arma::fmat&, double,
+                                     const arma::mat&, double,
+                                     const arma::rowvec&, const arma::vec&,
+                                     const arma::vec&, const arma::vec&,
+                                     const arma::vec&, int, int);
+template BetaGam update_betagam_sw(Rng&, const arma::vec&, const arma::mat&,
+                                   const arma::vec&, const arma::vec&,
+                                   const arma::mat&, const arma::rowvec&,
+                                   double, ProposalScale&, int, int, double, int);
+template BetaGam update_betagam_sw(Rng&, const arma::vec&, const arma::fmat&,
+                                   const arma::vec&, const arma::vec&,
+                                   const arma::mat&, const arma::rowvec&,
+                                   double, ProposalScale&, int, int, double, int);
+
+}
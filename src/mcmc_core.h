@@ -0,0 +1,706 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// sampler core. Plain Armadillo only - no Rcpp types and no R API - so the
+// same code is linked into the R package (via LocalAnc.cpp) and into the
+// standalone tools under standalone/ (built with -DMCMCARMA_STANDALONE).
+#ifndef MCMCARMA_CORE_H
+#define MCMCARMA_CORE_H
+
+#ifdef MCMCARMA_STANDALONE
+#include <armadillo>
+#else
+#include <RcppArmadillo.h>
+#endif
+#include <ostream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rng.h"
+#include "patterns.h"
+
+namespace mcmc {
+
+const double log2pi = std::log(2.0 * arma::datum::pi);
+
+struct GammaProposal {
+  arma::vec gam;
+  int changeind;
+};
+
+struct BetaGam {
+  arma::vec gam;
+  arma::vec beta;
+  arma::vec tar;
+};
+
+struct HSigma {
+  double h;
+  double sigbeta;
+};
+
+//per-coordinate random-walk scales of the beta proposal. While adapt is set,
+//each coordinate moved by a regular step takes a Robbins-Monro step on its
+//log scale towards the target acceptance probability; freeze after burn-in.
+//The MALA step size (update_beta_mala) is adapted the same way.
+struct ProposalScale {
+  arma::vec logsd;
+  arma::uvec nadapt;    //adaptation steps taken by each coordinate
+  double target;
+  double mala_logeps;
+  arma::uword mala_nadapt;
+  bool adapt;
+  arma::uvec proposed;  //(regular, small-world, MALA, swap) moves proposed and accepted
+  arma::uvec accepted;
+  arma::uvec screened;  //(regular, small-world) moves the surrogate rejected
+  ProposalScale() : target(0.234), mala_logeps(0), mala_nadapt(0), adapt(false),
+                    proposed(4, arma::fill::zeros),
+                    accepted(4, arma::fill::zeros),
+                    screened(2, arma::fill::zeros) {}
+  ProposalScale(int T, double Vbeta, bool adapt_)
+    : logsd(T), nadapt(T, arma::fill::zeros), target(0.234), mala_logeps(0),
+      mala_nadapt(0), adapt(adapt_),
+      proposed(4, arma::fill::zeros), accepted(4, arma::fill::zeros),
+      screened(2, arma::fill::zeros) {
+    logsd.fill(0.5*std::log(Vbeta));
+  }
+};
+
+//bump allocator for the scratch arrays of one target evaluation: reset(),
+//reserve() the total, then take() consecutive slices. The buffer only ever
+//grows, so once it has reached its working size nothing is allocated.
+class Arena {
+public:
+  Arena() : used(0) {}
+  void reset(){ used = 0; }
+  //only between reset() and the first take(), which keeps slices valid
+  void reserve(size_t n){ if(used == 0 && buf.size() < n){buf.resize(n);} }
+  double* take(size_t n){
+    if(used + n > buf.size()){
+      throw std::logic_error("Arena: take() beyond reserve()");
+    }
+    double* p = buf.data() + used;
+    used += n;
+    return p;
+  }
+private:
+  std::vector<double> buf;
+  size_t used;
+};
+
+//scratch buffers of one chain's beta/gamma sampler, sized once for T so
+//that inner steps reuse them; after the first outer iteration a step makes
+//no heap allocations (with the pattern-wise targets)
+struct Workspace {
+  arma::vec gam2;        //single-move proposal
+  arma::vec beta2;
+  arma::vec gamsw;       //small-world composite move
+  arma::vec betasw;
+  arma::vec betasw2;
+  arma::vec sdbeta;      //exp(scale.logsd)
+  arma::rowvec marcor2;  //flip_marcor(marcor)
+  arma::uvec idx;        //candidate traits of one gamma move
+  arma::vec weight;      //and their weights
+  Arena arena;           //target evaluations
+  void reserve(int T){
+    if(gam2.n_elem == static_cast<arma::uword>(T)){return;}
+    gam2.set_size(T); beta2.set_size(T);
+    gamsw.set_size(T); betasw.set_size(T); betasw2.set_size(T);
+    sdbeta.set_size(T); marcor2.set_size(T);
+    idx.set_size(T); weight.set_size(T);
+  }
+};
+
+//replica exchange over (gamma, beta): tempered copies of one chain that run
+//in parallel threads, each with its own generator, and periodically propose
+//to swap states between neighbouring temperatures
+struct TemperedChain {
+  arma::vec invtemp;            //inverse temperatures, invtemp(0) == 1
+  std::vector<arma::vec> gam;   //replica states, index 0 is the cold chain
+  std::vector<arma::vec> beta;
+  arma::vec logtarget;          //cached log target of each replica state
+  std::vector<NativeRng> rng;
+  std::vector<ProposalScale> scale;  //per temperature, not swapped
+  std::vector<Workspace> ws;         //per replica
+  arma::uvec swap_proposed;     //per neighbouring pair (k, k+1)
+  arma::uvec swap_accepted;
+};
+
+//the data of one run, validated and preprocessed once. X and Y are held by
+//reference (typically R's own memory) and must outlive the Data object.
+//The sampler itself only reads the observed entries, packed by missingness
+//pattern (pack_patterns), so its copy of Y shrinks with the missing
+//fraction and no kernel scans for NaNs. With single set the packed values
+//are float, halving the bandwidth of the likelihood and residual passes;
+//densities, sums and Cholesky factors stay in double.
+//Covariates Z (n x q, no missing values) are projected out of X and Y once,
+//per trait over its observed rows (see project_covariates); X and Y then
+//refer to the adjusted copies, so the sampler's cost does not depend on q.
+struct Data {
+  arma::vec Xadj;                 //covariate-adjusted copies, only with Z
+  arma::mat Yadj;
+  const arma::vec& X;
+  const arma::mat& Y;
+  std::vector<arma::mat> Yp;      //packed observed values, unless single
+  std::vector<arma::fmat> Ypf;    //the same in float, only if single
+  bool single;
+  int n;
+  int T;
+  arma::rowvec marcor;            //|marginal_cor(X, Y)|, from the patterns
+  std::vector<Pattern> patterns;  //missing_patterns(X, Y)
+  Data(const arma::vec& X_, const arma::mat& Y_, bool single_ = false,
+       const arma::mat& Z = arma::mat());
+private:
+  Data(const Data&);              //X and Y may refer to members
+  Data& operator=(const Data&);
+};
+
+//Sigma = Lambda Lambda' + diag(d) with k = Lambda.n_cols factors. Used in
+//place of the dense Sigma for large T: likelihood evaluations cost O(T k)
+//per row and nothing T x T is ever formed (factor.cpp).
+struct FactorCov {
+  arma::mat Lambda;  //T x k loadings
+  arma::vec d;       //idiosyncratic variances
+  arma::vec diag() const { return arma::sum(arma::square(Lambda), 1) + d; }
+};
+
+//conjugate priors of the factor model: Lambda_tj ~ N(0, 1/lambda_prec),
+//d_t ~ inverse gamma(a, b)
+struct FactorPrior {
+  double lambda_prec;
+  double a;
+  double b;
+  FactorPrior() : lambda_prec(1), a(1), b(1) {}
+};
+
+//state of one chain between outer iterations
+struct ChainState {
+  arma::vec gam;
+  arma::vec beta;
+  arma::mat Sigma;
+  FactorCov fac;        //replaces Sigma if fac.Lambda has columns
+  double sigmabeta;
+  double h;
+  arma::vec tar;
+  ProposalScale scale;  //fixed sqrt(Vbeta) scales if left empty
+  Workspace ws;         //scratch of the beta/gamma update
+  TemperedChain pt;  //empty unless init_tempering() was called
+};
+
+//how DenseTarget evaluates the likelihood on packed data
+enum LikelihoodKernel {
+  KERNEL_AUTO = 0,     //chosen by choose_kernel()
+  KERNEL_ROWS = 1,     //every row of every pattern, O(n T^2) per evaluation
+  KERNEL_SUFFSTAT = 2  //closed form from the patterns' sums of x^2, x y and
+                       //y y': O(T^2) per evaluation, O(patterns T^3) setup
+};
+const char* kernel_name(LikelihoodKernel kernel);
+//inverse of kernel_name(); throws std::invalid_argument
+LikelihoodKernel kernel_from_name(const std::string& name);
+
+//tuning constants of the sampler
+struct SamplerOptions {
+  int bgiter;    //beta/gamma proposals per outer iteration
+  int hiter;     //h proposals per outer iteration
+  int switer;    //single moves chained into one small-world move
+  int swapiter;  //inner steps between replica swap proposals
+  int malaiter;  //MALA beta steps given gamma per outer iteration, 0 = none
+  bool delayed;  //screen beta/gamma proposals with DiagonalTarget first
+  double swapprob;  //share of regular steps that are swap moves instead
+  LikelihoodKernel kernel;  //of DenseTarget; KERNEL_AUTO: choose_kernel()
+  FactorPrior factor_prior;
+  SamplerOptions() : bgiter(500), hiter(50), switer(50), swapiter(10),
+                     malaiter(0), delayed(false), swapprob(0),
+                     kernel(KERNEL_AUTO) {}
+};
+
+//log target of (gamma, beta) for fixed covariance and sigmabeta; the beta
+//and gamma updates only see the model through this. Implementations must
+//be safe to call concurrently (tempered replicas share one).
+class Target {
+public:
+  virtual ~Target() {}
+  //(log likelihood, log beta prior, log gamma prior); scratch arrays come
+  //from the caller's arena
+  virtual arma::vec eval(const arma::vec& gam, const arma::vec& beta,
+                         Arena& arena) const = 0;
+  arma::vec components(const arma::vec& gam, const arma::vec& beta) const {
+    Arena arena;
+    return eval(gam, beta, arena);
+  }
+  double operator()(const arma::vec& gam, const arma::vec& beta,
+                    Arena& arena) const {
+    return arma::accu(eval(gam, beta, arena));
+  }
+  double operator()(const arma::vec& gam, const arma::vec& beta) const {
+    return arma::accu(components(gam, beta));
+  }
+  //log target of (gam2, beta2) minus cur, the log target of (gam1, beta1),
+  //where the two states differ in coordinates i and j only (swap moves).
+  //A full evaluation unless the target has a cheaper update
+  virtual double pair_delta(const arma::vec& gam1, const arma::vec& beta1,
+                            double cur, const arma::vec& gam2,
+                            const arma::vec& beta2, int i, int j,
+                            Arena& arena) const {
+    (void)gam1; (void)beta1; (void)i; (void)j;
+    return (*this)(gam2, beta2, arena) - cur;
+  }
+};
+
+//densities and samplers
+double log_dnorm(double x, double mu, double sd);
+double dmvnrm(const arma::rowvec& x, const arma::rowvec& mean,
+              const arma::mat& sigma, bool logd);
+arma::mat mvrnorm(Rng& rng, int n, const arma::vec& mu, const arma::mat& Sigma);
+arma::cube rinvwish(Rng& rng, int n, int v, const arma::mat& S);
+int sample_index(Rng& rng, const arma::vec& prob);
+int sample_index(Rng& rng, const double* prob, int n);
+int sample_uniform(Rng& rng, int size);
+
+//kernels templated on eT read Y as arma::Mat<eT>; they are instantiated
+//for double and float in mcmc_core.cpp
+
+//data summaries
+template<typename eT>
+double marginal_cor_col(const arma::vec& X, const arma::Mat<eT>& Y, arma::uword t);
+template<typename eT>
+arma::rowvec marginal_cor(const arma::vec& X, const arma::Mat<eT>& Y);
+template<typename eT>
+arma::mat em_with_zero_mean(const arma::Mat<eT>& y, int maxit);
+//em_with_zero_mean() of the residuals Y - X beta' (n rows in all) from the
+//packed values. Rows of a pattern share their missing set, so an iteration
+//works on per-pattern sums and costs O(patterns T^3) rather than O(n T^2)
+template<typename eT>
+arma::mat em_with_zero_mean(const std::vector<Pattern>& patterns,
+                            const std::vector<arma::Mat<eT> >& Yp,
+                            const arma::vec& beta, int n, int maxit);
+
+//model; h and sigmabeta only depend on the diagonal of Sigma
+double get_sigmabeta_from_h(double h, const arma::vec& gam,
+                            const arma::vec& sigdiag, const arma::vec& X);
+double get_h_from_sigmabeta(const arma::vec& X, double sigmabeta,
+                            const arma::vec& sigdiag, const arma::vec& gam, int n);
+double log_gamma_prior(int s, int T);
+//(L, log beta prior, log gamma prior) given the log likelihood L
+arma::vec target_parts(double L, double sigmabeta, const arma::vec& sigdiag,
+                       const arma::vec& gam, const arma::vec& beta);
+//change in the two priors of target_parts() from (gam1, beta1) to
+//(gam2, beta2), which differ in coordinates i and j only
+double prior_pair_delta(double sigmabeta, const arma::vec& sigdiag,
+                        const arma::vec& gam1, const arma::vec& beta1,
+                        const arma::vec& gam2, const arma::vec& beta2,
+                        int i, int j);
+template<typename eT>
+arma::vec get_target(const arma::vec& X, const arma::Mat<eT>& Y, double sigmabeta,
+                     const arma::mat& Sigma, const arma::vec& gam,
+                     const arma::vec& beta);
+
+//small T (fixed_t.cpp): kernels with compile-time sizes for T <= max_fixed_T,
+//selected by T at run time. Sigma blocks and Cholesky factors live in stack
+//arrays and observed sets come from Pattern::mask, so nothing is allocated
+//per row or per pattern.
+const int max_fixed_T = 8;
+inline bool fixed_t_supported(int T){ return T >= 1 && T <= max_fixed_T; }
+//get_target() computed pattern by pattern from the packed values, one
+//Cholesky factor per pattern
+template<typename eT>
+arma::vec get_target_fixed(const std::vector<Pattern>& patterns,
+                           const std::vector<arma::Mat<eT> >& Yp,
+                           double sigmabeta, const arma::mat& Sigma,
+                           const arma::vec& gam, const arma::vec& beta);
+//one draw of rinvwish(), same random stream
+arma::mat rinvwish_fixed(Rng& rng, int v, const arma::mat& S);
+
+//the closed form of KERNEL_SUFFSTAT: fills q as beta_quadratic() does and
+//returns c, so that the log likelihood is c + g'beta - beta'H beta/2.
+//Needs the patterns' syy (fill_syy())
+double likelihood_quadratic(const std::vector<Pattern>& patterns,
+                            const arma::mat& Sigma, BetaQuadratic& q);
+
+//get_target() with a dense Sigma. On dense X and Y it is get_target()
+//itself; on the data's packed patterns it uses the fixed-size kernel for
+//small T, and otherwise inverse Cholesky factors of each pattern's block
+//computed once in the constructor. With quadratic set it also keeps the
+//likelihood's quadratic form in beta, so that pair_delta() costs O(T);
+//that form comes from double sums, so on float values only the closed form
+//(KERNEL_SUFFSTAT, whose evaluations use the same form) has the cheap
+//update, and the row kernel falls back to a full evaluation.
+//KERNEL_SUFFSTAT replaces the rows by that form and the patterns' sums of
+//y y'; choose_kernel() picks between the two for a run.
+template<typename eT>
+class DenseTarget : public Target {
+public:
+  DenseTarget(const arma::vec& X, const arma::Mat<eT>& Y, double sigmabeta,
+              const arma::mat& Sigma);
+  DenseTarget(const std::vector<Pattern>& patterns,
+              const std::vector<arma::Mat<eT> >& Yp, double sigmabeta,
+              const arma::mat& Sigma, LikelihoodKernel kernel = KERNEL_ROWS,
+              bool quadratic = false);
+  arma::vec eval(const arma::vec& gam, const arma::vec& beta,
+                 Arena& arena) const;
+  double pair_delta(const arma::vec& gam1, const arma::vec& beta1, double cur,
+                    const arma::vec& gam2, const arma::vec& beta2, int i,
+                    int j, Arena& arena) const;
+private:
+  const arma::vec* X;
+  const arma::Mat<eT>* Y;
+  const std::vector<Pattern>* patterns;
+  const std::vector<arma::Mat<eT> >* Yp;
+  double sigmabeta;
+  const arma::mat& Sigma;
+  arma::vec sigdiag;
+  std::vector<arma::mat> Rinv;  //T > max_fixed_T: chol(Sigma_oo)^-1 (upper)
+  arma::vec logdet;             //and log |Sigma_oo|
+  BetaQuadratic q;              //beta_quadratic(), if asked for
+  bool suffstat;                //KERNEL_SUFFSTAT: loglik = c + g'beta -
+  double c;                     //beta'H beta/2 from q
+};
+
+//the same target with a factor covariance; per-pattern Woodbury factors are
+//computed once in the constructor, so each row costs O(|observed| k).
+//pair_delta() goes through the patterns' sums instead of the rows, at
+//O(|observed| k) per pattern; on float values it is a full evaluation, as
+//for DenseTarget.
+template<typename eT>
+class FactorTarget : public Target {
+public:
+  FactorTarget(const std::vector<Pattern>& patterns,
+               const std::vector<arma::Mat<eT> >& Yp, double sigmabeta,
+               const FactorCov& fac);
+  arma::vec eval(const arma::vec& gam, const arma::vec& beta,
+                 Arena& arena) const;
+  double pair_delta(const arma::vec& gam1, const arma::vec& beta1, double cur,
+                    const arma::vec& gam2, const arma::vec& beta2, int i,
+                    int j, Arena& arena) const;
+private:
+  const std::vector<Pattern>& patterns;
+  const std::vector<arma::Mat<eT> >& Yp;
+  double sigmabeta;
+  const FactorCov& fac;
+  arma::vec sigdiag;
+  //per pattern: 1/d_o, W = R^-T L_o' with R'R = I + L_o' D_o^-1 L_o, so
+  //that r' Sigma_oo^-1 r = r'D_o^-1 r - |W D_o^-1 r|^2, and log |Sigma_oo|
+  std::vector<arma::vec> dinv;
+  std::vector<arma::mat> W;
+  arma::vec logdet;
+};
+
+//first stage of delayed acceptance: the likelihood with Sigma replaced by
+//its diagonal, from per-trait sums over the patterns, so an evaluation
+//costs O(T). Its log likelihood is only right up to a constant in beta,
+//which is all a ratio needs.
+class DiagonalTarget : public Target {
+public:
+  DiagonalTarget(const std::vector<Pattern>& patterns, double sigmabeta,
+                 const arma::vec& sigdiag);
+  arma::vec eval(const arma::vec& gam, const arma::vec& beta,
+                 Arena& arena) const;
+private:
+  double sigmabeta;
+  arma::vec sigdiag;
+  arma::vec sxx;  //per trait, over the rows where it is observed
+  arma::vec sxy;
+};
+
+//updates
+GammaProposal update_gamma(Rng& rng, const arma::vec& X, const arma::mat& Y,
+                           const arma::vec& gam);
+GammaProposal update_gamma_sw(Rng& rng, const arma::vec& gam,
+                              const arma::rowvec& marcor);
+//update_gamma_sw() into gam2 using the workspace's index buffers; returns
+//the flipped trait
+int propose_gamma_sw(Rng& rng, const arma::vec& gam, const arma::rowvec& marcor,
+                     const arma::rowvec& marcor2, Workspace& ws,
+                     arma::vec& gam2);
+arma::rowvec flip_marcor(const arma::rowvec& marcor);
+double sw_proposal_ratio(const arma::rowvec& marcor, const arma::rowvec& marcor2,
+                         const arma::vec& gam1, const arma::vec& gam2,
+                         double dbeta, int changeind, int change);
+arma::vec betagam_accept(const arma::vec& X, const arma::mat& Y,
+                         double sigmabeta1, const arma::mat& inputSigma,
+                         double Vbeta,
+                         const arma::vec& gam1, const arma::vec& beta1,
+                         const arma::vec& gam2, const arma::vec& beta2,
+                         int changeind, int change);
+arma::vec betagam_accept_sw(const arma::vec& X, const arma::mat& Y,
+                            double sigmabeta1, const arma::mat& inputSigma,
+                            double Vbeta,
+                            const arma::vec& gam1, const arma::vec& beta1,
+                            const arma::vec& gam2, const arma::vec& beta2,
+                            int changeind, int change);
+template<typename eT>
+arma::vec betagam_accept_sw(const arma::vec& X, const arma::Mat<eT>& Y,
+                            double sigmabeta1, const arma::mat& inputSigma,
+                            double Vbeta, const arma::rowvec& marcor,
+                            const arma::vec& gam1, const arma::vec& beta1,
+                            const arma::vec& gam2, const arma::vec& beta2,
+                            int changeind, int change);
+BetaGam update_betagam(Rng& rng, const arma::vec& X, const arma::mat& Y,
+                       arma::vec gam1, arma::vec beta1, const arma::mat& Sigma,
+                       double sigmabeta, double Vbeta, int bgiter);
+BetaGam update_betagam_sw(Rng& rng, const arma::vec& X, const arma::mat& Y,
+                          const arma::vec& gam1, const arma::vec& beta1,
+                          const arma::mat& Sigma, const arma::rowvec& marcor,
+                          double sigmabeta, double Vbeta,
+                          int bgiter, int smallworlditer,
+                          double invtemp = 1.0, int offset = 0);
+template<typename eT>
+BetaGam update_betagam_sw(Rng& rng, const arma::vec& X, const arma::Mat<eT>& Y,
+                          const arma::vec& gam1, const arma::vec& beta1,
+                          const arma::mat& Sigma, const arma::rowvec& marcor,
+                          double sigmabeta, ProposalScale& scale,
+                          int bgiter, int smallworlditer,
+                          double invtemp = 1.0, int offset = 0);
+//with a surrogate, each proposal first has to pass a Metropolis-Hastings
+//test on the surrogate and only then is the target evaluated, with the
+//second-stage ratio (target/surrogate) keeping the target invariant.
+//A run split into pieces (update_betagam_pt) passes the number of steps
+//already made as offset, so that small-world moves keep their every-10th
+//schedule, and the log target of (gam1, beta1) as logtarget when it has
+//it; nan evaluates it
+BetaGam update_betagam_sw(Rng& rng, const Target& target,
+                          const arma::rowvec& marcor,
+                          const arma::vec& gam1, const arma::vec& beta1,
+                          ProposalScale& scale, Workspace& ws,
+                          int bgiter, int smallworlditer,
+                          double invtemp = 1.0, const Target* surrogate = 0,
+                          double swapprob = 0, int offset = 0,
+                          double logtarget = arma::datum::nan);
+//niter preconditioned MALA steps on the active coordinates of beta given
+//gamma; the target is exactly quadratic in beta, so each step costs one
+//|active|^2 product with the cached precision
+void update_beta_mala(Rng& rng, const BetaQuadratic& q, const arma::mat& Sigma,
+                      double sigmabeta, const arma::vec& gam, arma::vec& beta,
+                      int niter, ProposalScale& scale);
+HSigma update_h(Rng& rng, double initialh, int hiter, const arma::vec& gam,
+                const arma::vec& beta, const arma::vec& sigdiag,
+                const arma::vec& X);
+template<typename eT>
+arma::mat update_Sigma(Rng& rng, int n, int nu, const arma::vec& X,
+                       const arma::vec& beta, const arma::mat& Phi,
+                       const arma::Mat<eT>& Y);
+template<typename eT>
+arma::mat update_Sigma(Rng& rng, int n, int nu,
+                       const std::vector<Pattern>& patterns,
+                       const std::vector<arma::Mat<eT> >& Yp,
+                       const arma::vec& beta, const arma::mat& Phi);
+
+//factor covariance (factor.cpp)
+//variance of the observed values in each column of Y; 1 where that is not
+//a positive number
+arma::vec observed_variances(const arma::mat& Y);
+//loadings and variances scaled so that diag(Sigma) starts near the observed
+//variances of Y
+void init_factor_cov(Rng& rng, const Data& data, int k, FactorCov& fac);
+//one Gibbs sweep over the latent factors, Lambda and d given the residuals
+//Y - X beta', with missing entries left out of every sum
+template<typename eT>
+void update_factor_cov(Rng& rng, const std::vector<Pattern>& patterns,
+                       const std::vector<arma::Mat<eT> >& Yp,
+                       const arma::vec& beta, const FactorPrior& prior,
+                       FactorCov& fac);
+
+//replica exchange (tempering.cpp)
+//64-bit seed for a chain's own NativeRng, drawn from rng
+uint64_t draw_seed(Rng& rng);
+void init_tempering(Rng& rng, int ntemps, double maxtemp, ChainState& state);
+void update_betagam_pt(Rng& rng, const Target& target, const arma::rowvec& marcor,
+                       const SamplerOptions& opt, TemperedChain& pt,
+                       const Target* surrogate = 0);
+
+//stop adapting the proposal scales (all replicas) and reset the acceptance
+//counts, so that they cover the post burn-in iterations only
+void freeze_adaptation(ChainState& state);
+//scales and acceptance counts of the chain's cold (untempered) updates
+const ProposalScale& cold_scale(const ChainState& state);
+
+//one outer iteration (beta/gamma, Sigma or its factors, h) of a single chain
+void outer_iteration(Rng& rng, const Data& data, const arma::mat& Phi, int nu,
+                     double Vbeta, const SamplerOptions& opt,
+                     ChainState& state);
+
+//kernel dispatch (dispatch.cpp): the DenseTarget kernel for a chain on data
+//at state's Sigma, sigmabeta, gamma and beta. By default it compares
+//operation counts per outer iteration from the shape of the data (rows and
+//observed traits of each pattern); with tune it times every kernel's setup
+//and a few evaluations instead. cost, if given, gets the estimate of each
+//kernel, indexed by LikelihoodKernel (operations, or seconds with tune)
+LikelihoodKernel choose_kernel(const Data& data, const ChainState& state,
+                               const SamplerOptions& opt, bool tune,
+                               arma::vec* cost = 0);
+
+//model registry (models.cpp): one entry per distinct gamma visited, so
+//model-level summaries need O(models T) memory instead of a draw per
+//iteration
+struct ModelStats {
+  std::vector<uint64_t> bits;  //gamma, 64 traits per word
+  long visits;
+  arma::vec betasum;           //sum of beta over the visits
+  double logtarget;            //log target at the latest visit
+};
+
+class ModelRegistry {
+public:
+  explicit ModelRegistry(int T = 0) : T(T), n(0) {}
+  void record(const arma::vec& gam, const arma::vec& beta, double logtarget);
+  long total() const { return n; }
+  size_t size() const { return models.size(); }
+  //the k most visited models, ties in order of first visit
+  std::vector<const ModelStats*> top(size_t k) const;
+  arma::vec gamma(const ModelStats& m) const;
+private:
+  struct BitsHash {
+    size_t operator()(const std::vector<uint64_t>& bits) const;
+  };
+  int T;
+  long n;
+  std::vector<ModelStats> models;  //in order of first visit
+  std::unordered_map<std::vector<uint64_t>, size_t, BitsHash> index;
+  std::vector<uint64_t> key;       //scratch of record()
+};
+
+//two chains run side by side (chains.cpp): the loop of run2chains_c, so
+//that the R package and the standalone tools share it
+struct RunOptions {
+  SamplerOptions sampler;
+  int niter;
+  int burnin;    //adaptation, and the start of the convergence sums
+  int ntemps;    //> 1: tempered replicas per chain (init_tempering)
+  double maxtemp;
+  bool adapt;    //tune the beta proposal scales during burn-in
+  int nfactors;  //> 0: Sigma = Lambda Lambda' + D (init_factor_cov)
+  bool models;   //model registry instead of per-iteration gamma and beta
+  bool tune;     //time the likelihood kernels rather than use the cost model
+  double screen; //log Bayes factor below which no sampling is done; -inf
+                 //off. Dense Sigma only
+  RunOptions() : niter(1000), burnin(5), ntemps(1), maxtemp(10), adapt(true),
+                 nfactors(0), models(false), tune(false),
+                 screen(-arma::datum::inf) {}
+};
+
+//receives every draw of a chain as it is made, e.g. to write it to disk
+class TraceSink {
+public:
+  virtual ~TraceSink() {}
+  virtual void draw(int i, const ChainState& state) = 0;
+};
+
+//draws of one chain, one column (slice) per outer iteration. With factors
+//the covariance is kept as Lambda (T x k) and D instead of Sigma. With
+//models set, gamma and beta are not kept per iteration and post burn-in
+//draws go to the registry instead. With a sink, draws are passed on and
+//nothing is kept per iteration. Post burn-in sums of gamma and of beta
+//where gamma is 1 drive the convergence check either way.
+struct ChainTrace {
+  arma::mat beta;
+  arma::mat gam;
+  arma::cube Sigma;
+  arma::cube Lambda;
+  arma::mat D;
+  arma::vec sb;
+  arma::vec h;
+  arma::mat tar;
+  int burnin;
+  arma::vec gamsum;
+  arma::vec betasum;
+  int npost;
+  bool models;
+  ModelRegistry registry;
+  TraceSink* sink;
+  ChainTrace(int T, int niter, int k, int burnin, bool models,
+             TraceSink* sink = 0);
+  void record(int i, const ChainState& state);
+  //keep iterations 0..i
+  void truncate(int i);
+};
+
+enum Convergence {
+  NOT_CONVERGED = 0,
+  CONVERGED_NULL = 1,  //both chains select no trait
+  CONVERGED_BETA = 2,  //same traits and close mean effects
+  SCREENED_NULL = 3    //stopped before sampling by RunOptions::screen
+};
+
+struct RunResult {
+  int iterations;  //outer iterations kept, including the initial state
+  Convergence converged;
+  LikelihoodKernel kernel;  //the one used; KERNEL_AUTO with factors
+  double logbf;             //screen_logbf() of chain 1's start; nan unscreened
+};
+
+//checks the options, sets up both chains from their initial gamma, beta,
+//Sigma (unless nfactors > 0) and sigmabeta, fixes the likelihood kernel if
+//it is KERNEL_AUTO, and runs at most opt.niter iterations, stopping early
+//once the chains agree. With a finite opt.screen, a dataset whose
+//screen_logbf() falls below it is not sampled: the result is SCREENED_NULL
+//with only the initial states recorded. Progress goes to log if given.
+RunResult run_two_chains(Rng& rng, const Data& data, const arma::mat& Phi,
+                         const RunOptions& opt, ChainState& state1,
+                         ChainState& state2, ChainTrace& trace1,
+                         ChainTrace& trace2, std::ostream* log = 0);
+//starts of the standalone tools: chain 1 with every trait in at its
+//marginal effect, chain 2 with none, both at the EM estimate of Sigma
+//unless Sigma is given (it depends on Y alone, so a scan can share it).
+//With nfactors > 0 run_two_chains() starts Sigma from init_factor_cov(),
+//so the dense EM is skipped and Sigma is diag(observed_variances(Y)).
+void default_starts(const Data& data, double sigmabeta, ChainState& state1,
+                    ChainState& state2, const arma::mat& Sigma = arma::mat(),
+                    int nfactors = 0);
+//screen (screen.cpp): log Bayes factor against beta = 0 with Sigma fixed,
+//the larger of the model with every trait in and the best single-trait
+//model; the T single-trait ones go to single if given
+double screen_logbf(const Data& data, const arma::mat& Sigma, double sigmabeta,
+                    arma::vec* single = 0);
+
+//lockstep batches (batch.cpp): B chains with a dense Sigma advanced
+//together, each on its own data (restarts share one Data; SNPs of a
+//phenotype panel have one each). Per-chain state is structure-of-arrays,
+//B x T with the chain index fastest, and the likelihood is the closed form
+//of KERNEL_SUFFSTAT, so the log targets, the Metropolis tests and the h
+//random walk are loops over chains that vectorise; only the proposals and
+//the Sigma draws are made chain by chain. Each chain has its own generator,
+//so its draws do not depend on B. The moves are those of
+//update_betagam_sw() with the fixed proposal scale sqrt(Vbeta).
+struct ChainBatch {
+  std::vector<const Data*> data;
+  std::vector<NativeRng> rng;
+  std::vector<arma::rowvec> marcor2;  //flip_marcor() of each chain's data
+  arma::mat gam;                 //B x T
+  arma::mat beta;
+  std::vector<arma::mat> Sigma;
+  arma::vec sigmabeta;           //B
+  arma::vec h;
+  arma::vec sd;                  //beta proposal scale
+  arma::vec xx;                  //sum(X^2)/n
+  arma::mat tar;                 //B x 3, as ChainState::tar
+  //log likelihood of chain b: c(b) + g.row(b) beta - beta'H(b,.,.)beta/2
+  arma::cube H;                  //B x T x T
+  arma::mat g;                   //B x T
+  arma::vec c;
+  arma::mat sigdiag;             //B x T
+  arma::mat logsigdiag;
+  arma::uvec proposed;           //(regular, small-world), over all chains
+  arma::uvec accepted;
+  int burnin;
+  int iter;                      //outer iterations done
+  arma::mat gamsum;              //B x T, after burn-in
+  arma::mat betasum;             //of beta where gamma is 1
+  arma::vec hsum;
+  int npost;
+  //scratch of batch_iteration()
+  arma::mat gam2, beta2, parts;
+  arma::vec cur, logq, logu, acc;
+  Workspace ws;
+};
+//chains start alternately from the two default_starts() states; their
+//generators are seeded from rng
+void init_batch(Rng& rng, const std::vector<const Data*>& data,
+                double sigmabeta, int burnin, ChainBatch& batch);
+//one outer iteration (beta/gamma, Sigma, h) of every chain. malaiter,
+//delayed and swapprob are not supported
+void batch_iteration(ChainBatch& batch, const arma::mat& Phi,
+                     const SamplerOptions& opt);
+
+}
+
+#endif
@@ -0,0 +1,72 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// visit counts of the models (distinct gamma vectors) a chain goes through
+#include "mcmc_core.h"
+#include <algorithm>
+
+namespace mcmc {
+
+size_t ModelRegistry::BitsHash::operator()(const std::vector<uint64_t>& bits) const {
+  //splitmix64 finaliser of each word, combined in order
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+  for (size_t w=0; w<bits.size(); ++w){
+    uint64_t z = bits[w] + h;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    h ^= z ^ (z >> 31);
+    h *= 0x100000001b3ULL;
+  }
+  return static_cast<size_t>(h);
+}
+
+void ModelRegistry::record(const arma::vec& gam, const arma::vec& beta,
+                           double logtarget){
+  if(gam.n_elem != static_cast<arma::uword>(T) || beta.n_elem != gam.n_elem){
+    throw std::invalid_argument("ModelRegistry: gamma or beta of wrong length");
+  }
+  key.assign((T+63)/64, 0);
+  for (int t=0; t<T; ++t){
+    if(gam(t)==1){key[t/64] |= uint64_t(1) << (t%64);}
+  }
+  size_t m;
+  std::unordered_map<std::vector<uint64_t>, size_t, BitsHash>::iterator it =
+    index.find(key);
+  if(it==index.end()){
+    m = models.size();
+    index[key] = m;
+    ModelStats s;
+    s.bits = key;
+    s.visits = 0;
+    s.betasum = arma::zeros<arma::vec>(T);
+    models.push_back(s);
+  }else{
+    m = it->second;
+  }
+  ModelStats& s = models[m];
+  s.visits++;
+  s.betasum += beta;
+  s.logtarget = logtarget;
+  n++;
+}
+
+static bool more_visits(const ModelStats* a, const ModelStats* b){
+  return a->visits > b->visits;
+}
+
+std::vector<const ModelStats*> ModelRegistry::top(size_t k) const {
+  std::vector<const ModelStats*> out(models.size());
+  for (size_t m=0; m<models.size(); ++m){out[m] = &models[m];}
+  //stable, so equal counts stay in order of first visit
+  std::stable_sort(out.begin(), out.end(), more_visits);
+  if(out.size() > k){out.resize(k);}
+  return out;
+}
+
+arma::vec ModelRegistry::gamma(const ModelStats& m) const {
+  arma::vec out(T);
+  for (int t=0; t<T; ++t){
+    out(t) = (m.bits[t/64] >> (t%64)) & 1u;
+  }
+  return out;
+}
+
+}
@@ -0,0 +1,169 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+#include "patterns.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace mcmc {
+
+std::vector<Pattern> missing_patterns(const arma::vec& X, const arma::mat& Y){
+  int n = Y.n_rows;
+  int T = Y.n_cols;
+  std::vector<Pattern> out;
+  std::map<std::vector<bool>, size_t> index;
+  std::vector<std::vector<arma::uword> > rows;
+  std::vector<bool> key(T);
+  for (int i=0; i<n; ++i){
+    int nobs = 0;
+    for (int t=0; t<T; ++t){
+      key[t] = arma::is_finite(Y(i,t));
+      nobs += key[t];
+    }
+    if(nobs==0){continue;}
+    std::map<std::vector<bool>, size_t>::iterator it = index.find(key);
+    size_t p;
+    if(it==index.end()){
+      p = out.size();
+      index[key] = p;
+      Pattern pat;
+      pat.obs.set_size(nobs);
+      pat.mask = 0;
+      for (int t=0, k=0; t<T; ++t){
+        if(key[t]){
+          pat.obs(k++) = t;
+          if(T <= 32){pat.mask |= uint32_t(1) << t;}
+        }
+      }
+      pat.sxx = 0;
+      pat.sxy = arma::zeros<arma::vec>(nobs);
+      out.push_back(pat);
+      rows.push_back(std::vector<arma::uword>());
+    }else{
+      p = it->second;
+    }
+    Pattern& pat = out[p];
+    rows[p].push_back(i);
+    pat.sxx += X(i)*X(i);
+    for (arma::uword k=0; k<pat.obs.n_elem; ++k){
+      pat.sxy(k) += X(i)*Y(i, pat.obs(k));
+    }
+  }
+  for (size_t p=0; p<out.size(); ++p){
+    out[p].rows = arma::conv_to<arma::uvec>::from(rows[p]);
+    out[p].x = X(out[p].rows);
+  }
+  return out;
+}
+
+void fill_syy(const std::vector<Pattern>& patterns, const arma::mat& Y){
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    if(!pat.syy.is_empty()){continue;}
+    arma::mat y = Y.submat(pat.rows, pat.obs);
+    pat.syy = y.t() * y;
+  }
+}
+
+template<typename eT>
+std::vector<arma::Mat<eT> > pack_patterns(const arma::mat& Y,
+                                          const std::vector<Pattern>& patterns){
+  std::vector<arma::Mat<eT> > out(patterns.size());
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    arma::Mat<eT>& b = out[p];
+    b.set_size(pat.obs.n_elem, pat.rows.n_elem);
+    for (arma::uword k=0; k<pat.rows.n_elem; ++k){
+      for (arma::uword j=0; j<pat.obs.n_elem; ++j){
+        b(j,k) = static_cast<eT>(Y(pat.rows(k), pat.obs(j)));
+      }
+    }
+  }
+  return out;
+}
+
+arma::rowvec marginal_cor(const std::vector<Pattern>& patterns, int T){
+  arma::rowvec s = arma::zeros<arma::rowvec>(T);
+  arma::rowvec cnt = arma::zeros<arma::rowvec>(T);
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    for (arma::uword j=0; j<pat.obs.n_elem; ++j){
+      s(pat.obs(j)) += pat.sxy(j);
+      cnt(pat.obs(j)) += pat.rows.n_elem;
+    }
+  }
+  return s/cnt;
+}
+
+static arma::mat covariate_basis(const arma::mat& Zr){
+  //orthonormal basis of the columns of Zr from one QR; falls back to an
+  //SVD basis if Zr is rank deficient
+  arma::mat Q, R;
+  arma::qr_econ(Q, R, Zr);
+  arma::vec rd = arma::abs(R.diag());
+  double tol = (rd.n_elem > 0) ?
+    rd.max() * std::max(Zr.n_rows, Zr.n_cols) * arma::datum::eps : 0;
+  if(arma::accu(rd > tol) < Zr.n_cols){
+    Q = arma::orth(Zr);
+  }
+  return Q;
+}
+
+void project_covariates(const arma::mat& Z, const std::vector<Pattern>& patterns,
+                        arma::vec& X, arma::mat& Y){
+  arma::mat Q = covariate_basis(Z);
+  if(Q.n_cols == 0){return;}
+  if(Z.n_rows <= Q.n_cols){
+    throw std::invalid_argument("covariates: no more rows than rank(covariates)");
+  }
+  X -= Q*(Q.t()*X);
+  //traits observed in the same patterns share their rows, and one QR
+  std::map<std::vector<bool>, std::vector<arma::uword> > groups;
+  for (arma::uword t=0; t<Y.n_cols; ++t){
+    std::vector<bool> key(patterns.size());
+    for (size_t p=0; p<patterns.size(); ++p){
+      key[p] = arma::any(patterns[p].obs == t);
+    }
+    groups[key].push_back(t);
+  }
+  for (std::map<std::vector<bool>, std::vector<arma::uword> >::const_iterator
+         it = groups.begin(); it != groups.end(); ++it){
+    std::vector<arma::uword> rows;
+    for (size_t p=0; p<patterns.size(); ++p){
+      if(it->first[p]){
+        rows.insert(rows.end(), patterns[p].rows.begin(), patterns[p].rows.end());
+      }
+    }
+    std::sort(rows.begin(), rows.end());
+    arma::uvec r = arma::conv_to<arma::uvec>::from(rows);
+    arma::uvec cols = arma::conv_to<arma::uvec>::from(it->second);
+    arma::mat Qr = covariate_basis(Z.rows(r));
+    if(r.n_elem <= Qr.n_cols){
+      throw std::invalid_argument("covariates: a column of Y has no more "
+                                  "observed values than rank(covariates)");
+    }
+    arma::mat y = Y.submat(r, cols);
+    Y.submat(r, cols) = y - Qr*(Qr.t()*y);
+  }
+}
+
+BetaQuadratic beta_quadratic(const std::vector<Pattern>& patterns,
+                             const arma::mat& Sigma){
+  int T = Sigma.n_rows;
+  BetaQuadratic out;
+  out.H = arma::zeros<arma::mat>(T,T);
+  out.g = arma::zeros<arma::vec>(T);
+  for (size_t p=0; p<patterns.size(); ++p){
+    const Pattern& pat = patterns[p];
+    arma::mat P = arma::inv_sympd(Sigma(pat.obs, pat.obs));
+    out.H(pat.obs, pat.obs) += pat.sxx * P;
+    out.g(pat.obs) += P * pat.sxy;
+  }
+  return out;
+}
+
+template std::vector<arma::mat> pack_patterns(const arma::mat&,
+                                              const std::vector<Pattern>&);
+template std::vector<arma::fmat> pack_patterns(const arma::mat&,
+                                               const std::vector<Pattern>&);
+
+}
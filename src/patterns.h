@@ -0,0 +1,67 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// rows of Y grouped by missingness pattern, with the sufficient statistics
+// of the single-SNP regression on each group. Everything that is Gaussian
+// in beta only needs these, not the individual rows.
+#ifndef MCMCARMA_PATTERNS_H
+#define MCMCARMA_PATTERNS_H
+
+#ifdef MCMCARMA_STANDALONE
+#include <armadillo>
+#else
+#include <RcppArmadillo.h>
+#endif
+#include <stdint.h>
+#include <vector>
+
+namespace mcmc {
+
+struct Pattern {
+  arma::uvec obs;    //observed traits
+  uint32_t mask;     //bit t set if trait t is observed; 0 if T > 32
+  arma::uvec rows;   //rows of Y with exactly these traits observed
+  arma::vec x;       //X at those rows
+  double sxx;        //sum of X^2 over rows
+  arma::vec sxy;     //sum of X*y over rows, observed traits only
+  mutable arma::mat syy;  //sum of y y' over rows, observed traits only;
+                          //empty until fill_syy()
+};
+
+//patterns in order of first appearance; rows with nothing observed are dropped
+std::vector<Pattern> missing_patterns(const arma::vec& X, const arma::mat& Y);
+
+//fills each pattern's syy from the Y the patterns were built from, if not
+//done yet. Only the closed-form likelihood (KERNEL_SUFFSTAT, ChainBatch)
+//reads syy, so it is computed on first use rather than for every dataset;
+//call it before the patterns are shared between threads.
+void fill_syy(const std::vector<Pattern>& patterns, const arma::mat& Y);
+
+//observed values of Y packed by pattern: block p is |obs| x |rows| with one
+//column per row, so kernels read each row contiguously and never see a
+//missing entry. Built once; instantiated for double and float.
+template<typename eT>
+std::vector<arma::Mat<eT> > pack_patterns(const arma::mat& Y,
+                                          const std::vector<Pattern>& patterns);
+
+//marginal_cor(X, Y) from the patterns' sums, without touching Y
+arma::rowvec marginal_cor(const std::vector<Pattern>& patterns, int T);
+
+//residualises X and Y on the covariates Z (n x q): X over all rows, and
+//each column of Y over the rows where it is observed, so every trait spends
+//rank(Z) degrees of freedom once. Traits observed in the same patterns
+//share one QR of their rows of Z. Throws if a trait has no more observed
+//rows than rank(Z).
+void project_covariates(const arma::mat& Z, const std::vector<Pattern>& patterns,
+                        arma::vec& X, arma::mat& Y);
+
+//log likelihood in beta is  g'beta - beta'H beta/2 + const  for fixed Sigma
+struct BetaQuadratic {
+  arma::mat H;  //sum over patterns of sxx * Sigma_oo^-1, embedded in T x T
+  arma::vec g;  //sum over patterns of Sigma_oo^-1 sxy, embedded in T
+};
+
+BetaQuadratic beta_quadratic(const std::vector<Pattern>& patterns,
+                             const arma::mat& Sigma);
+
+}
+
+#endif
@@ -0,0 +1,46 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// random number source used by the sampler core. The R package plugs in R's
+// generator (see RRng in LocalAnc.cpp) so set.seed() keeps working; the
+// standalone tools use NativeRng.
+#ifndef MCMCARMA_RNG_H
+#define MCMCARMA_RNG_H
+
+#include <random>
+#include <stdint.h>
+
+namespace mcmc {
+
+class Rng {
+public:
+  virtual ~Rng() {}
+  //uniform on (0,1)
+  virtual double unif() = 0;
+  //standard normal
+  virtual double norm() = 0;
+  //chi-squared with df degrees of freedom
+  virtual double chisq(double df) = 0;
+};
+
+class NativeRng : public Rng {
+public:
+  explicit NativeRng(uint64_t seed) : eng(seed) {}
+  double unif(){
+    double u;
+    do { u = unif01(eng); } while (u <= 0.0);
+    return u;
+  }
+  double norm(){ return norm01(eng); }
+  double chisq(double df){
+    std::chi_squared_distribution<double> d(df);
+    return d(eng);
+  }
+  void seed(uint64_t s){ eng.seed(s); norm01.reset(); }
+private:
+  std::mt19937_64 eng;
+  std::uniform_real_distribution<double> unif01;
+  std::normal_distribution<double> norm01;
+};
+
+}
+
+#endif
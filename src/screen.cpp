@@ -0,0 +1,43 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// pre-sampling screen of a run. With Sigma fixed the likelihood is
+// c + g'beta - beta'H beta/2 (beta_quadratic), so the evidence for a
+// model against beta = 0 under the sampler's prior beta_t ~ N(0, v_t),
+// v_t = sigmabeta Sigma_tt, integrates in closed form: with D = diag(sqrt(v)),
+//
+//   log BF = -log|I + D H D|/2 + (D g)'(I + D H D)^-1 (D g)/2.
+//
+// The cost is one pass over the patterns and a T x T factorisation, next
+// to 2 x burnin outer iterations for the null convergence check.
+#include "mcmc_core.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace mcmc {
+
+double screen_logbf(const Data& data, const arma::mat& Sigma, double sigmabeta,
+                    arma::vec* single){
+  int T = data.T;
+  BetaQuadratic q = beta_quadratic(data.patterns, Sigma);
+  arma::vec d = arma::sqrt(sigmabeta*Sigma.diag());
+  //one trait at a time
+  arma::vec bf(T);
+  for (int t=0; t<T; ++t){
+    double v = d(t)*d(t);
+    double m = 1 + v*q.H(t,t);
+    bf(t) = -0.5*std::log(m) + 0.5*v*q.g(t)*q.g(t)/m;
+  }
+  //every trait in
+  arma::mat M = q.H % (d*d.t());
+  M.diag() += 1;
+  arma::mat R;
+  if(!arma::chol(R, M)){
+    throw std::runtime_error("screen_logbf: I + D H D is not positive definite");
+  }
+  arma::vec z = arma::solve(arma::trimatl(R.t()), arma::vec(d % q.g));
+  double all = -arma::accu(arma::log(R.diag())) + 0.5*arma::dot(z, z);
+  if(single){*single = bf;}
+  return std::max(all, bf.max());
+}
+
+}
@@ -0,0 +1,39 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+#include "simulate.h"
+
+namespace mcmc {
+
+SimData simulate_data(Rng& rng, int n, int T, double missing, double sparsity,
+                      double sigmabeta){
+  SimData out;
+  //genotypes 0/1/2
+  out.X.set_size(n);
+  for (int i=0; i<n; ++i){
+    out.X(i) = sample_uniform(rng, 3);
+  }
+  //Sigma ~ inverse Wishart(nu, Phi*nu) with Phi = I, nu = T+5
+  int nu = T+5;
+  arma::mat Phi = arma::eye<arma::mat>(T,T);
+  out.Sigma = rinvwish(rng, 1, nu, Phi*nu).slice(0);
+  out.gamma = arma::zeros<arma::vec>(T);
+  out.beta = arma::zeros<arma::vec>(T);
+  for (int t=0; t<T; ++t){
+    if(rng.unif() >= sparsity){
+      out.gamma(t) = 1;
+      out.beta(t) = std::sqrt(sigmabeta*out.Sigma(t,t))*rng.norm();
+    }
+  }
+  out.Y = out.X * out.beta.t() + mvrnorm(rng, n, arma::zeros<arma::vec>(T), out.Sigma);
+  //knock out round(missing*n*T) entries chosen without replacement
+  arma::uword N = out.Y.n_elem;
+  arma::uword nmiss = static_cast<arma::uword>(std::floor(missing*N + 0.5));
+  arma::uvec perm = arma::regspace<arma::uvec>(0, N-1);
+  for (arma::uword k=0; k<nmiss && k<N; ++k){
+    arma::uword j = k + sample_uniform(rng, N-k);
+    std::swap(perm(k), perm(j));
+    out.Y(perm(k)) = arma::datum::nan;
+  }
+  return out;
+}
+
+}
@@ -0,0 +1,26 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// synthetic datasets for benchmarking and testing the sampler core; the
+// C++ counterpart of R/createData.R without the MCMCpack/MASS dependency
+#ifndef MCMCARMA_SIMULATE_H
+#define MCMCARMA_SIMULATE_H
+
+#include "mcmc_core.h"
+
+namespace mcmc {
+
+struct SimData {
+  arma::vec X;
+  arma::mat Y;
+  arma::vec gamma;
+  arma::vec beta;
+  arma::mat Sigma;
+};
+
+//n samples, T traits, a fraction 'missing' of Y set to NaN and a fraction
+//'sparsity' of traits with no effect (gamma == 0)
+SimData simulate_data(Rng& rng, int n, int T, double missing, double sparsity,
+                      double sigmabeta = 0.5);
+
+}
+
+#endif
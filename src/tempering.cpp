@@ -0,0 +1,91 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// replica exchange for the beta/gamma sampler
+#include "mcmc_core.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace mcmc {
+
+uint64_t draw_seed(Rng& rng){
+  //drawn from the caller's generator so runs stay reproducible from a
+  //single seed
+  uint64_t hi = static_cast<uint64_t>(rng.unif() * 4294967296.0);
+  uint64_t lo = static_cast<uint64_t>(rng.unif() * 4294967296.0);
+  return (hi << 32) | lo;
+}
+
+void init_tempering(Rng& rng, int ntemps, double maxtemp, ChainState& state){
+  //geometric temperature ladder 1 = t_0 < ... < t_{K-1} = maxtemp, all
+  //replicas starting from the chain's current state and proposal scales
+  if(state.scale.logsd.n_elem != state.gam.n_elem){
+    throw std::invalid_argument("init_tempering: chain has no proposal scale");
+  }
+  TemperedChain& pt = state.pt;
+  pt.invtemp.set_size(ntemps);
+  for (int k=0; k<ntemps; ++k){
+    double frac = (ntemps > 1) ? static_cast<double>(k)/(ntemps-1) : 0;
+    pt.invtemp(k) = std::pow(maxtemp, -frac);
+  }
+  pt.gam.assign(ntemps, state.gam);
+  pt.beta.assign(ntemps, state.beta);
+  pt.logtarget = arma::zeros<arma::vec>(ntemps);
+  pt.scale.assign(ntemps, state.scale);
+  pt.ws.assign(ntemps, Workspace());
+  pt.rng.clear();
+  for (int k=0; k<ntemps; ++k){
+    pt.rng.push_back(NativeRng(draw_seed(rng)));
+  }
+  pt.swap_proposed = arma::zeros<arma::uvec>(ntemps > 1 ? ntemps-1 : 0);
+  pt.swap_accepted = arma::zeros<arma::uvec>(ntemps > 1 ? ntemps-1 : 0);
+}
+
+void update_betagam_pt(Rng& rng, const Target& target, const arma::rowvec& marcor,
+                       const SamplerOptions& opt, TemperedChain& pt,
+                       const Target* surrogate){
+  //bgiter-1 inner steps on every replica, in rounds of swapiter steps run
+  //in parallel, each round followed by swap proposals between neighbouring
+  //temperatures. Swaps only touch the cached log targets, which carry over
+  //from round to round; the first round evaluates them, as the target has
+  //changed since the last call. Rounds continue the small-world schedule of
+  //update_betagam_sw() from the steps already done.
+  int K = pt.invtemp.n_elem;
+  std::string err;
+
+  int done = 1;
+  while (done < opt.bgiter){
+    int steps = std::min(opt.swapiter, opt.bgiter-done);
+#pragma omp parallel for schedule(dynamic)
+    for (int k=0; k<K; ++k){
+      try {
+        BetaGam bg = update_betagam_sw(pt.rng[k], target, marcor, pt.gam[k],
+                                       pt.beta[k], pt.scale[k], pt.ws[k],
+                                       steps+1, opt.switer, pt.invtemp(k),
+                                       surrogate, opt.swapprob, done-1,
+                                       (done == 1) ? arma::datum::nan :
+                                       pt.logtarget(k));
+        pt.gam[k] = bg.gam;
+        pt.beta[k] = bg.beta;
+        pt.logtarget(k) = bg.tar(steps);
+      } catch (std::exception& e) {
+#pragma omp critical
+        err = e.what();
+      }
+    }
+    if(!err.empty()){throw std::runtime_error(err);}
+    done += steps;
+
+    for (int k=0; k+1<K; ++k){
+      double A = (pt.invtemp(k)-pt.invtemp(k+1))*(pt.logtarget(k+1)-pt.logtarget(k));
+      pt.swap_proposed(k)++;
+      if(std::exp(A) > rng.unif()){
+        pt.gam[k].swap(pt.gam[k+1]);
+        pt.beta[k].swap(pt.beta[k+1]);
+        std::swap(pt.logtarget(k), pt.logtarget(k+1));
+        pt.swap_accepted(k)++;
+      }
+    }
+  }
+}
+
+}
@@ -0,0 +1,381 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// throughput benchmark for the sampler core, independent of R.
+//
+// Generates synthetic datasets over a grid of n, T, missing fraction and
+// sparsity and times the main kernels. One CSV record per (dataset, kernel)
+// goes to stdout:
+//
+//   kernel,n,T,missing,sparsity,reps,ns_per_op,ops_per_sec,maxrss_kb,allocs_per_op
+//
+// ops_per_sec of the inner_step kernel is proposals/sec; maxrss_kb is the
+// process memory high-water mark after the kernel ran; allocs_per_op counts
+// malloc/posix_memalign calls (glibc only, -1 elsewhere). inner_step runs on
+// a warmed-up chain workspace, so its allocations are the per-call ones;
+// inner_step_da is the same with delayed acceptance (DiagonalTarget) and
+// inner_step_swap with half the regular steps made swap moves. With
+// --ntemps K > 1 an outer_iteration_pt record times the same iteration with
+// K tempered replicas.
+// The _f32 kernels read a float copy of Y; --single 1 runs the outer
+// iterations on float storage as well. dense_target is the target the sampler
+// evaluates (per missingness pattern, fixed-size kernels for T <= 8) and
+// suffstat_target its closed form (one setup and one evaluation per op).
+// --factors k > 0 adds get_target_factor and outer_iteration_factor
+// records for a k-factor covariance. --batch B > 0 adds
+// outer_iteration_batch, B chains on the dataset in lockstep
+// (mcmc::ChainBatch); its ops are chain iterations, so it compares directly
+// with outer_iteration.
+//
+//   ./bench --n 1000,10000 --T 5,20 --missing 0,0.5 --sparsity 0.8 --reps 10
+#include <sys/resource.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mcmc_core.h"
+#include "simulate.h"
+
+#if defined(__GLIBC__)
+//count heap allocations by interposing malloc and posix_memalign (which
+//Armadillo uses for anything above its small local buffer)
+extern "C" {
+void* __libc_malloc(size_t n);
+void* __libc_memalign(size_t align, size_t n);
+}
+
+static std::atomic<unsigned long> alloc_count(0);
+
+extern "C" void* malloc(size_t n) noexcept {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(n);
+}
+
+extern "C" int posix_memalign(void** out, size_t align, size_t n) noexcept {
+  alloc_count.fetch_add(1, std::memory_order_relaxed);
+  void* p = __libc_memalign(align, n);
+  if(!p){return ENOMEM;}
+  *out = p;
+  return 0;
+}
+
+static long allocations(){ return alloc_count.load(); }
+#else
+static long allocations(){ return -1; }
+#endif
+
+struct BenchOptions {
+  std::vector<int> n;
+  std::vector<int> T;
+  std::vector<double> missing;
+  std::vector<double> sparsity;
+  int reps;
+  int bgiter;
+  int hiter;
+  int switer;
+  int ntemps;
+  int malaiter;
+  int factors;
+  int batch;
+  bool single;
+  uint64_t seed;
+};
+
+static std::vector<double> parse_list(const char* s){
+  std::vector<double> out;
+  std::string str(s);
+  size_t start = 0;
+  while (start <= str.size()){
+    size_t end = str.find(',', start);
+    if(end == std::string::npos){end = str.size();}
+    if(end > start){out.push_back(std::atof(str.substr(start, end-start).c_str()));}
+    start = end + 1;
+  }
+  return out;
+}
+
+static std::vector<int> parse_int_list(const char* s){
+  std::vector<double> d = parse_list(s);
+  return std::vector<int>(d.begin(), d.end());
+}
+
+static long maxrss_kb(){
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_maxrss;
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static long allocs_at_start;
+
+static bench_clock::time_point start_kernel(){
+  allocs_at_start = allocations();
+  return bench_clock::now();
+}
+
+static void report(const char* kernel, int n, int T, double missing,
+                   double sparsity, int reps, double seconds){
+  double ns = seconds*1e9/reps;
+  long a = allocations();
+  double allocs = (a < 0) ? -1 : static_cast<double>(a - allocs_at_start)/reps;
+  std::printf("%s,%d,%d,%g,%g,%d,%.1f,%.3f,%ld,%.2f\n", kernel, n, T, missing,
+              sparsity, reps, ns, reps/seconds, maxrss_kb(), allocs);
+  std::fflush(stdout);
+}
+
+static double elapsed(bench_clock::time_point start){
+  return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void bench_dataset(const BenchOptions& opt, mcmc::Rng& rng,
+                          int n, int T, double missing, double sparsity){
+  mcmc::SimData d = mcmc::simulate_data(rng, n, T, missing, sparsity);
+  int nu = T+5;
+  arma::mat Phi = arma::eye<arma::mat>(T,T);
+  mcmc::Data data(d.X, d.Y, opt.single);
+  double Vbeta = arma::accu(data.marcor%data.marcor) * 0.01;
+  double sigmabeta = 0.5;
+  volatile double sink = 0;
+
+  bench_clock::time_point start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    sink += mcmc::get_target(d.X, d.Y, sigmabeta, d.Sigma, d.gamma, d.beta)(0);
+  }
+  report("get_target", n, T, missing, sparsity, opt.reps, elapsed(start));
+
+  arma::fmat Yf = arma::conv_to<arma::fmat>::from(d.Y);
+  start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    sink += mcmc::get_target(d.X, Yf, sigmabeta, d.Sigma, d.gamma, d.beta)(0);
+  }
+  report("get_target_f32", n, T, missing, sparsity, opt.reps, elapsed(start));
+
+  //the sampler's target on the packed values: pattern-wise, fixed-size
+  //kernels for T <= 8. Packed here so that --single does not matter
+  std::vector<arma::mat> Yp = mcmc::pack_patterns<double>(d.Y, data.patterns);
+  mcmc::DenseTarget<double> dense(data.patterns, Yp, sigmabeta, d.Sigma);
+  start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    sink += dense(d.gamma, d.beta);
+  }
+  report("dense_target", n, T, missing, sparsity, opt.reps, elapsed(start));
+
+  //the closed form, setup included as it is paid per outer iteration
+  mcmc::fill_syy(data.patterns, data.Y);
+  start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    mcmc::DenseTarget<double> ss(data.patterns, Yp, sigmabeta, d.Sigma,
+                                 mcmc::KERNEL_SUFFSTAT);
+    sink += ss(d.gamma, d.beta);
+  }
+  report("suffstat_target", n, T, missing, sparsity, opt.reps, elapsed(start));
+
+  arma::mat resid = d.Y - d.X * d.beta.t();
+  start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    sink += mcmc::em_with_zero_mean(resid, 100)(0,0);
+  }
+  report("em_with_zero_mean", n, T, missing, sparsity, opt.reps, elapsed(start));
+
+  arma::fmat residf = arma::conv_to<arma::fmat>::from(resid);
+  start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    sink += mcmc::em_with_zero_mean(residf, 100)(0,0);
+  }
+  report("em_with_zero_mean_f32", n, T, missing, sparsity, opt.reps,
+         elapsed(start));
+
+  //the sampler's EM, on per-pattern sums of the packed values
+  start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    sink += mcmc::em_with_zero_mean(data.patterns, Yp, d.beta, n, 100)(0,0);
+  }
+  report("em_packed", n, T, missing, sparsity, opt.reps, elapsed(start));
+
+  arma::mat S = d.Sigma*n + Phi*nu;
+  start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    sink += mcmc::rinvwish(rng, 1, n+nu, S)(0,0,0);
+  }
+  report("rinvwish", n, T, missing, sparsity, opt.reps, elapsed(start));
+
+  //single inner proposals: bgiter steps of the small-world sampler, which
+  //includes the chained move on every 10th step, after a short warm-up
+  //call that sizes the workspace
+  int nprop = opt.bgiter-1;
+  mcmc::ProposalScale scale(T, Vbeta, false);
+  mcmc::Workspace ws;
+  mcmc::BetaGam bg = mcmc::update_betagam_sw(rng, dense, data.marcor, d.gamma,
+                                             d.beta, scale, ws, 2, opt.switer);
+  start = start_kernel();
+  bg = mcmc::update_betagam_sw(rng, dense, data.marcor, d.gamma, d.beta, scale,
+                               ws, opt.bgiter, opt.switer);
+  report("inner_step", n, T, missing, sparsity, nprop, elapsed(start));
+  sink += bg.beta(0);
+
+  //the same with delayed acceptance on the diagonal surrogate
+  mcmc::DiagonalTarget diag(data.patterns, sigmabeta, d.Sigma.diag());
+  mcmc::ProposalScale scale_da(T, Vbeta, false);
+  bg = mcmc::update_betagam_sw(rng, dense, data.marcor, d.gamma, d.beta,
+                               scale_da, ws, 2, opt.switer, 1.0, &diag);
+  start = start_kernel();
+  bg = mcmc::update_betagam_sw(rng, dense, data.marcor, d.gamma, d.beta,
+                               scale_da, ws, opt.bgiter, opt.switer, 1.0, &diag);
+  report("inner_step_da", n, T, missing, sparsity, nprop, elapsed(start));
+  sink += bg.beta(0);
+
+  //half of the regular steps as swaps, priced by the quadratic form
+  mcmc::DenseTarget<double> dense_q(data.patterns, Yp, sigmabeta, d.Sigma,
+                                    mcmc::KERNEL_ROWS, true);
+  mcmc::ProposalScale scale_swap(T, Vbeta, false);
+  bg = mcmc::update_betagam_sw(rng, dense_q, data.marcor, d.gamma, d.beta,
+                               scale_swap, ws, 2, opt.switer, 1.0, 0, 0.5);
+  start = start_kernel();
+  bg = mcmc::update_betagam_sw(rng, dense_q, data.marcor, d.gamma, d.beta,
+                               scale_swap, ws, opt.bgiter, opt.switer, 1.0, 0,
+                               0.5);
+  report("inner_step_swap", n, T, missing, sparsity, nprop, elapsed(start));
+  sink += bg.beta(0);
+
+  mcmc::SamplerOptions sopt;
+  sopt.bgiter = opt.bgiter;
+  sopt.hiter = opt.hiter;
+  sopt.switer = opt.switer;
+  sopt.malaiter = opt.malaiter;
+  mcmc::ChainState state;
+  state.gam = d.gamma;
+  state.beta = d.beta;
+  state.Sigma = d.Sigma;
+  state.sigmabeta = sigmabeta;
+  state.h = mcmc::get_h_from_sigmabeta(d.X, sigmabeta, d.Sigma.diag(),
+                                       d.gamma, n);
+  start = start_kernel();
+  for (int r=0; r<opt.reps; ++r){
+    mcmc::outer_iteration(rng, data, Phi, nu, Vbeta, sopt, state);
+  }
+  report("outer_iteration", n, T, missing, sparsity, opt.reps, elapsed(start));
+  sink += state.h;
+
+  //same, with the beta/gamma update run as ntemps tempered replicas
+  if(opt.ntemps > 1){
+    mcmc::init_tempering(rng, opt.ntemps, 10, state);
+    start = start_kernel();
+    for (int r=0; r<opt.reps; ++r){
+      mcmc::outer_iteration(rng, data, Phi, nu, Vbeta, sopt, state);
+    }
+    report("outer_iteration_pt", n, T, missing, sparsity, opt.reps,
+           elapsed(start));
+    sink += state.h;
+  }
+
+  //Sigma = Lambda Lambda' + D with opt.factors factors (no MALA step)
+  if(opt.factors > 0){
+    mcmc::SamplerOptions fopt = sopt;
+    fopt.malaiter = 0;
+    mcmc::ChainState fstate;
+    fstate.gam = d.gamma;
+    fstate.beta = d.beta;
+    fstate.sigmabeta = sigmabeta;
+    mcmc::init_factor_cov(rng, data, opt.factors, fstate.fac);
+    fstate.h = mcmc::get_h_from_sigmabeta(d.X, sigmabeta, fstate.fac.diag(),
+                                          d.gamma, n);
+    start = start_kernel();
+    for (int r=0; r<opt.reps; ++r){
+      mcmc::FactorTarget<double> target(data.patterns, Yp, sigmabeta,
+                                        fstate.fac);
+      sink += target(d.gamma, d.beta);
+    }
+    report("get_target_factor", n, T, missing, sparsity, opt.reps,
+           elapsed(start));
+    start = start_kernel();
+    for (int r=0; r<opt.reps; ++r){
+      mcmc::outer_iteration(rng, data, Phi, nu, Vbeta, fopt, fstate);
+    }
+    report("outer_iteration_factor", n, T, missing, sparsity, opt.reps,
+           elapsed(start));
+    sink += fstate.h;
+  }
+
+  //opt.batch chains in lockstep, with MALA off as the batch has no such step
+  if(opt.batch > 0){
+    mcmc::SamplerOptions bopt = sopt;
+    bopt.malaiter = 0;
+    std::vector<const mcmc::Data*> chains(opt.batch, &data);
+    mcmc::ChainBatch batch;
+    mcmc::init_batch(rng, chains, sigmabeta, 0, batch);
+    start = start_kernel();
+    for (int r=0; r<opt.reps; ++r){
+      mcmc::batch_iteration(batch, Phi, bopt);
+    }
+    report("outer_iteration_batch", n, T, missing, sparsity,
+           opt.reps*opt.batch, elapsed(start));
+    sink += batch.h(0);
+  }
+  (void)sink;
+}
+
+static void usage(){
+  std::fprintf(stderr,
+               "usage: bench [--n 1000,10000] [--T 5,20] [--missing 0,0.5]\n"
+               "             [--sparsity 0.8] [--reps 10] [--bgiter 100]\n"
+               "             [--hiter 50] [--switer 50] [--ntemps 1]\n"
+               "             [--malaiter 0] [--factors 0] [--batch 0]\n"
+               "             [--single 0] [--seed 1]\n");
+}
+
+int main(int argc, char** argv){
+  BenchOptions opt;
+  opt.n = parse_int_list("1000,10000");
+  opt.T = parse_int_list("5,20");
+  opt.missing = parse_list("0,0.5");
+  opt.sparsity = parse_list("0.8");
+  opt.reps = 10;
+  opt.bgiter = 100;
+  opt.hiter = 50;
+  opt.switer = 50;
+  opt.ntemps = 1;
+  opt.malaiter = 0;
+  opt.factors = 0;
+  opt.batch = 0;
+  opt.single = false;
+  opt.seed = 1;
+  for (int a=1; a<argc; ++a){
+    if(a+1 >= argc){usage(); return 1;}
+    const char* key = argv[a];
+    const char* val = argv[++a];
+    if(!std::strcmp(key, "--n")){opt.n = parse_int_list(val);}
+    else if(!std::strcmp(key, "--T")){opt.T = parse_int_list(val);}
+    else if(!std::strcmp(key, "--missing")){opt.missing = parse_list(val);}
+    else if(!std::strcmp(key, "--sparsity")){opt.sparsity = parse_list(val);}
+    else if(!std::strcmp(key, "--reps")){opt.reps = std::atoi(val);}
+    else if(!std::strcmp(key, "--bgiter")){opt.bgiter = std::atoi(val);}
+    else if(!std::strcmp(key, "--hiter")){opt.hiter = std::atoi(val);}
+    else if(!std::strcmp(key, "--switer")){opt.switer = std::atoi(val);}
+    else if(!std::strcmp(key, "--ntemps")){opt.ntemps = std::atoi(val);}
+    else if(!std::strcmp(key, "--malaiter")){opt.malaiter = std::atoi(val);}
+    else if(!std::strcmp(key, "--factors")){opt.factors = std::atoi(val);}
+    else if(!std::strcmp(key, "--batch")){opt.batch = std::atoi(val);}
+    else if(!std::strcmp(key, "--single")){opt.single = std::atoi(val) != 0;}
+    else if(!std::strcmp(key, "--seed")){opt.seed = std::strtoull(val, 0, 10);}
+    else {usage(); return 1;}
+  }
+  if(opt.reps < 1 || opt.bgiter < 2){usage(); return 1;}
+
+  mcmc::NativeRng rng(opt.seed);
+  std::printf("kernel,n,T,missing,sparsity,reps,ns_per_op,ops_per_sec,maxrss_kb,"
+              "allocs_per_op\n");
+  for (size_t a=0; a<opt.n.size(); ++a){
+    for (size_t b=0; b<opt.T.size(); ++b){
+      for (size_t c=0; c<opt.missing.size(); ++c){
+        for (size_t e=0; e<opt.sparsity.size(); ++e){
+          bench_dataset(opt, rng, opt.n[a], opt.T[b], opt.missing[c],
+                        opt.sparsity[e]);
+        }
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// pieces shared by the standalone tools: reading matrices and the sampler
+// options they take by name (scan from its manifest, run2chains from the
+// command line).
+#ifndef MCMCARMA_STANDALONE_OPTIONS_H
+#define MCMCARMA_STANDALONE_OPTIONS_H
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include "mcmc_core.h"
+
+//anything arma::mat::load() detects: CSV, whitespace separated text,
+//Armadillo binary
+inline arma::mat load_matrix(const std::string& path){
+  arma::mat M;
+  if(!M.load(path)){throw std::runtime_error("cannot read matrix " + path);}
+  return M;
+}
+
+//sets the run option called key (the argument names of run2chains_c;
+//factors is nfactors) from its text value; false if there is none
+inline bool set_run_option(mcmc::RunOptions& run, const std::string& key,
+                           const std::string& val){
+  const char* v = val.c_str();
+  if(key == "niter"){run.niter = std::atoi(v);}
+  else if(key == "bgiter"){run.sampler.bgiter = std::atoi(v);}
+  else if(key == "hiter"){run.sampler.hiter = std::atoi(v);}
+  else if(key == "switer"){run.sampler.switer = std::atoi(v);}
+  else if(key == "burnin"){run.burnin = std::atoi(v);}
+  else if(key == "ntemps"){run.ntemps = std::atoi(v);}
+  else if(key == "maxtemp"){run.maxtemp = std::atof(v);}
+  else if(key == "swapiter"){run.sampler.swapiter = std::atoi(v);}
+  else if(key == "adapt"){run.adapt = std::atoi(v) != 0;}
+  else if(key == "malaiter"){run.sampler.malaiter = std::atoi(v);}
+  else if(key == "delayed"){run.sampler.delayed = std::atoi(v) != 0;}
+  else if(key == "swapprob"){run.sampler.swapprob = std::atof(v);}
+  else if(key == "factors"){run.nfactors = std::atoi(v);}
+  else if(key == "kernel"){run.sampler.kernel = mcmc::kernel_from_name(val);}
+  else if(key == "tune"){run.tune = std::atoi(v) != 0;}
+  else if(key == "screen"){run.screen = std::atof(v);}
+  else {return false;}
+  return true;
+}
+
+#endif
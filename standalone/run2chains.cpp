@@ -0,0 +1,220 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// run2chains_c without R: reads the data from files and streams the draws
+// to disk instead of holding them for the end of the run.
+//
+//   ./run2chains --X X.csv --Y Y.csv --out results [--Phi Phi.csv]
+//                [--niter 1000 --bgiter 500 --hiter 50 --switer 50 --burnin 5 ...]
+//
+// Options are those of run2chains_c (factors is nfactors), plus
+//
+//   --X, --Y         n x 1 and n x T, nan for missing in Y (required)
+//   --Phi            prior scale of Sigma, default identity
+//   --covariates     n x q, projected out before sampling (see mcmc::Data)
+//   --out            directory for the results (required)
+//   --sigmabeta      starting sigmabeta of both chains, default 0.5
+//   --seed           seed of the generator, default 1
+//   --progress 1     print the iteration count to stderr
+//
+// Matrices are anything arma::mat::load() detects (CSV, whitespace
+// separated text, Armadillo binary). Both chains start from
+// mcmc::default_starts(). Files written to the output directory:
+//
+//   chainK.tsv        one line per iteration, flushed as it is drawn: iter,
+//                     sigmabeta, h, the three parts of the log target
+//                     (nan at iteration 0), gamma[T], beta[T]
+//   chainK.Sigma.bin  per iteration Sigma (T x T), or with factors Lambda
+//                     (T x k) then d (T), doubles in column-major order and
+//                     native byte order
+//   chainK.models.tsv with --models K > 0: the K most visited models after
+//                     burn-in, as in run2chains_c
+//   summary.tsv       per trait, posterior inclusion probability and mean
+//                     beta where included, both chains after burn-in
+//   run.txt           iterations, convergence status (mcmc::Convergence),
+//                     likelihood kernel used, log Bayes factor of the
+//                     screen (nan without --screen)
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "options.h"
+
+//writes each draw of one chain as it is made
+class FileSink : public mcmc::TraceSink {
+public:
+  FileSink(const std::string& prefix)
+    : tsv(std::fopen((prefix + ".tsv").c_str(), "w")),
+      bin(std::fopen((prefix + ".Sigma.bin").c_str(), "wb")) {
+    if(!tsv || !bin){
+      close();
+      throw std::runtime_error("cannot write " + prefix + ".tsv");
+    }
+  }
+  ~FileSink(){close();}
+  void draw(int i, const mcmc::ChainState& state){
+    int T = state.gam.n_elem;
+    if(i == 0){
+      std::fprintf(tsv, "iter\tsigmabeta\th\tloglik\tlogprior_beta\tlogprior_gamma");
+      for (int t=0; t<T; ++t){std::fprintf(tsv, "\tgamma%d", t);}
+      for (int t=0; t<T; ++t){std::fprintf(tsv, "\tbeta%d", t);}
+      std::fprintf(tsv, "\n");
+    }
+    std::fprintf(tsv, "%d\t%.10g\t%.10g", i, state.sigmabeta, state.h);
+    for (int k=0; k<3; ++k){
+      double v = (i > 0 && state.tar.n_elem == 3) ? state.tar(k) : arma::datum::nan;
+      std::fprintf(tsv, "\t%.10g", v);
+    }
+    for (int t=0; t<T; ++t){std::fprintf(tsv, "\t%g", state.gam(t));}
+    for (int t=0; t<T; ++t){std::fprintf(tsv, "\t%.10g", state.beta(t));}
+    std::fprintf(tsv, "\n");
+    bool ok;
+    if(state.fac.Lambda.n_cols > 0){
+      ok = write(state.fac.Lambda.memptr(), state.fac.Lambda.n_elem) &&
+        write(state.fac.d.memptr(), state.fac.d.n_elem);
+    }else{
+      ok = write(state.Sigma.memptr(), state.Sigma.n_elem);
+    }
+    if(!ok || std::fflush(tsv) != 0 || std::fflush(bin) != 0){
+      throw std::runtime_error("write failed");
+    }
+  }
+private:
+  bool write(const double* x, size_t n){
+    return std::fwrite(x, sizeof(double), n, bin) == n;
+  }
+  void close(){
+    if(tsv){std::fclose(tsv); tsv = 0;}
+    if(bin){std::fclose(bin); bin = 0;}
+  }
+  FILE* tsv;
+  FILE* bin;
+};
+
+static void write_models(const std::string& path,
+                         const mcmc::ModelRegistry& registry, int k){
+  FILE* f = std::fopen(path.c_str(), "w");
+  if(!f){throw std::runtime_error("cannot write " + path);}
+  std::vector<const mcmc::ModelStats*> top = registry.top(k);
+  std::fprintf(f, "# %ld draws, %ld models\n", registry.total(),
+               static_cast<long>(registry.size()));
+  std::fprintf(f, "rank\tvisits\tfreq\tlogtarget\tgamma");
+  int T = top.empty() ? 0 : top[0]->betasum.n_elem;
+  for (int t=0; t<T; ++t){std::fprintf(f, "\tbeta%d", t);}
+  std::fprintf(f, "\n");
+  for (size_t m=0; m<top.size(); ++m){
+    const mcmc::ModelStats& s = *top[m];
+    arma::vec gam = registry.gamma(s);
+    std::string bits;
+    for (int t=0; t<T; ++t){bits += (gam(t)==1) ? '1' : '0';}
+    std::fprintf(f, "%ld\t%ld\t%.6g\t%.10g\t%s", static_cast<long>(m+1),
+                 static_cast<long>(s.visits),
+                 double(s.visits)/registry.total(), s.logtarget, bits.c_str());
+    for (int t=0; t<T; ++t){std::fprintf(f, "\t%.10g", s.betasum(t)/s.visits);}
+    std::fprintf(f, "\n");
+  }
+  if(std::fclose(f) != 0){throw std::runtime_error("cannot write " + path);}
+}
+
+static void usage(){
+  std::fprintf(stderr,
+               "usage: run2chains --X FILE --Y FILE --out DIR [--Phi FILE]\n"
+               "                  [--covariates FILE] [--single 0|1] [--models K]\n"
+               "                  [--sigmabeta 0.5] [--seed 1] [--progress 0|1]\n"
+               "                  [--niter N --bgiter N --hiter N --switer N --burnin N\n"
+               "                   --ntemps N --maxtemp X --swapiter N --adapt 0|1\n"
+               "                   --malaiter N --delayed 0|1 --swapprob P --factors K\n"
+               "                   --kernel auto|rows|suffstat --tune 0|1\n"
+               "                   --screen LOGBF]\n");
+}
+
+int main(int argc, char** argv){
+  std::string xpath, ypath, phipath, zpath, out;
+  mcmc::RunOptions run;
+  bool single = false, progress = false;
+  int models = 0;
+  double sigmabeta = 0.5;
+  uint64_t seed = 1;
+  if(argc < 2 || argc % 2 == 0){usage(); return 1;}
+  try {
+    for (int a=1; a+1<argc; a+=2){
+      std::string key = argv[a];
+      std::string val = argv[a+1];
+      if(key.compare(0, 2, "--") != 0){usage(); return 1;}
+      key = key.substr(2);
+      if(key == "X"){xpath = val;}
+      else if(key == "Y"){ypath = val;}
+      else if(key == "Phi"){phipath = val;}
+      else if(key == "covariates"){zpath = val;}
+      else if(key == "out"){out = val;}
+      else if(set_run_option(run, key, val)){}
+      else if(key == "single"){single = std::atoi(val.c_str()) != 0;}
+      else if(key == "models"){models = std::atoi(val.c_str());}
+      else if(key == "sigmabeta"){sigmabeta = std::atof(val.c_str());}
+      else if(key == "seed"){seed = std::strtoull(val.c_str(), 0, 10);}
+      else if(key == "progress"){progress = std::atoi(val.c_str()) != 0;}
+      else {throw std::runtime_error("unknown option --" + key);}
+    }
+    if(xpath.empty() || ypath.empty() || out.empty()){usage(); return 1;}
+    if(models < 0){throw std::runtime_error("models must be non-negative");}
+    run.models = models > 0;
+    if(out[out.size()-1] != '/'){out += '/';}
+
+    arma::mat Xm = load_matrix(xpath);
+    arma::mat Y = load_matrix(ypath);
+    if(Xm.n_cols != 1 && Xm.n_rows != 1){
+      throw std::runtime_error("X must be a single column");
+    }
+    arma::vec X = arma::vectorise(Xm);
+    int T = Y.n_cols;
+    arma::mat Phi = phipath.empty() ? arma::eye<arma::mat>(T,T) : load_matrix(phipath);
+    arma::mat Z;
+    if(!zpath.empty()){Z = load_matrix(zpath);}
+
+    mcmc::Data data(X, Y, single, Z);
+    mcmc::ChainState state1, state2;
+    mcmc::default_starts(data, sigmabeta, state1, state2, arma::mat(),
+                         run.nfactors);
+    mkdir(out.c_str(), 0777);
+    FileSink sink1(out + "chain1");
+    FileSink sink2(out + "chain2");
+    mcmc::ChainTrace trace1(T, run.niter, run.nfactors, run.burnin, run.models,
+                            &sink1);
+    mcmc::ChainTrace trace2(T, run.niter, run.nfactors, run.burnin, run.models,
+                            &sink2);
+    mcmc::NativeRng rng(seed);
+    mcmc::RunResult res = mcmc::run_two_chains(rng, data, Phi, run, state1,
+                                               state2, trace1, trace2,
+                                               progress ? &std::cerr : 0);
+
+    FILE* f = std::fopen((out + "summary.tsv").c_str(), "w");
+    if(!f){throw std::runtime_error("cannot write " + out + "summary.tsv");}
+    double npost = trace1.npost + trace2.npost;
+    arma::vec gs = trace1.gamsum + trace2.gamsum;
+    arma::vec bs = trace1.betasum + trace2.betasum;
+    std::fprintf(f, "trait\tpip\tbeta\n");
+    for (int t=0; t<T; ++t){
+      std::fprintf(f, "%d\t%.6g\t%.10g\n", t, gs(t)/npost, bs(t)/gs(t));
+    }
+    bool ok = std::fclose(f) == 0;
+    f = std::fopen((out + "run.txt").c_str(), "w");
+    if(!f){throw std::runtime_error("cannot write " + out + "run.txt");}
+    std::fprintf(f, "iterations\t%d\nconverged\t%d\nn\t%d\nT\t%d\nseed\t%llu\n",
+                 res.iterations, static_cast<int>(res.converged), data.n, T,
+                 static_cast<unsigned long long>(seed));
+    std::fprintf(f, "kernel\t%s\n",
+                 run.nfactors > 0 ? "factor" : mcmc::kernel_name(res.kernel));
+    std::fprintf(f, "logbf\t%.10g\n", res.logbf);
+    ok = (std::fclose(f) == 0) && ok;
+    if(!ok){throw std::runtime_error("cannot write to " + out);}
+    if(models > 0){
+      write_models(out + "chain1.models.tsv", trace1.registry, models);
+      write_models(out + "chain2.models.tsv", trace2.registry, models);
+    }
+  } catch (std::exception& e) {
+    std::fprintf(stderr, "run2chains: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
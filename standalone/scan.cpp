@@ -0,0 +1,643 @@
+// -*- mode: C++; c-indent-level: 4; c-basic-offset: 4; indent-tabs-mode: nil; -*-
+// sharded genome-wide scan: run2chains_c once per SNP, without R.
+//
+//   ./scan worker MANIFEST K      process shard K
+//   ./scan run MANIFEST [--jobs N] run every unfinished shard, N at a time
+//   ./scan merge MANIFEST          combine the shard files
+//
+// The manifest is a text file of "key value" lines ('#' starts a comment);
+// relative paths are taken from the manifest's directory:
+//
+//   genotypes  G.csv     n x nsnp, one SNP per column (required)
+//   phenotypes Y.csv     n x T, nan for missing (required)
+//   traits     0,2,5     phenotype panel: columns of Y (0-based), default all
+//   covariates Z.csv     n x q, projected out per SNP (see mcmc::Data)
+//   phi        Phi.csv   prior scale of Sigma, default identity
+//   output     results   directory of the shard and merged files (required)
+//   shards     16        split all SNPs into 16 equal ranges, or instead
+//   range      0 5000    one shard per line over SNP columns [begin, end)
+//   niter, bgiter, hiter, switer, burnin, ntemps, maxtemp, swapiter,
+//   adapt, malaiter, delayed, swapprob, kernel, tune, screen, single,
+//   factors, sigmabeta, seed
+//
+// Matrices are anything arma::mat::load() detects (CSV, whitespace
+// separated text, Armadillo binary). A worker reads only its shard's
+// columns of the genotypes when they are text or Armadillo binary. Each SNP starts from
+// mcmc::default_starts() and gets its own generator seeded from (seed,
+// SNP), so results do not depend on the sharding or on restarts. The EM
+// estimate of Sigma they start from depends on Y (and Z) alone and is
+// computed once per worker. With screen, SNPs whose log Bayes factor
+// (mcmc::screen_logbf) is below it are not sampled and get pip 0.
+//
+// A worker appends one record per SNP to output/shard-K.part and flushes
+// it; a restarted worker keeps the complete records and carries on, and
+// renames the file to shard-K.bin when the shard is done. Files written
+// for a different manifest are rejected. merge checks that every shard is
+// done and writes output/scan.bin, one record per SNP from the first to the
+// last one covered by a shard (fixed size, so SNP j is at header +
+// (j-begin)*size), and the same as text in scan.tsv.
+//
+// Binary layout, native byte order. Header: 8-byte magic ("MCSHARD1" or
+// "MCSCAN01"), uint32 version, uint32 T, int64 begin, int64 end, uint64
+// manifest hash. Record: int64 snp, int32 status (-1 failed, -2 in no
+// shard, else mcmc::Convergence), int32 iterations, double h, double
+// pip[T], double beta[T] (post burn-in, both chains; beta is the mean
+// where included).
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "options.h"
+
+static const uint32_t format_version = 1;
+
+struct Manifest {
+  std::string dir;
+  std::string genotypes;
+  std::string phenotypes;
+  std::string covariates;
+  std::string phi;
+  std::string output;
+  std::vector<arma::uword> traits;
+  int shards;
+  std::vector<std::pair<long, long> > ranges;
+  mcmc::RunOptions run;
+  bool single;
+  double sigmabeta;
+  uint64_t seed;
+  uint64_t hash;
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t T;
+  int64_t begin;
+  int64_t end;
+  uint64_t hash;
+};
+
+struct SnpResult {
+  int64_t snp;
+  int32_t status;
+  int32_t iterations;
+  double h;
+  arma::vec pip;
+  arma::vec beta;
+};
+
+static uint64_t fnv1a(const std::string& s){
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (size_t i=0; i<s.size(); ++i){
+    h ^= static_cast<unsigned char>(s[i]);
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static uint64_t splitmix64(uint64_t z){
+  z += 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static std::string resolve(const std::string& dir, const std::string& path){
+  if(path.empty() || path[0] == '/'){return path;}
+  return dir + path;
+}
+
+static std::vector<arma::uword> parse_indices(const std::string& s){
+  std::vector<arma::uword> out;
+  std::stringstream ss(s);
+  std::string tok;
+  while (std::getline(ss, tok, ',')){
+    if(!tok.empty()){out.push_back(std::strtoul(tok.c_str(), 0, 10));}
+  }
+  return out;
+}
+
+static Manifest read_manifest(const std::string& path){
+  std::ifstream in(path.c_str());
+  if(!in){throw std::runtime_error("cannot read manifest " + path);}
+  std::stringstream text;
+  text << in.rdbuf();
+  Manifest m;
+  m.hash = fnv1a(text.str());
+  size_t slash = path.rfind('/');
+  m.dir = (slash == std::string::npos) ? "" : path.substr(0, slash+1);
+  m.shards = 0;
+  m.single = false;
+  m.sigmabeta = 0.5;
+  m.seed = 1;
+  std::string line;
+  while (std::getline(text, line)){
+    size_t hash = line.find('#');
+    if(hash != std::string::npos){line.resize(hash);}
+    std::stringstream ls(line);
+    std::string key, val;
+    if(!(ls >> key)){continue;}
+    if(!(ls >> val)){throw std::runtime_error("manifest: no value for " + key);}
+    if(key == "genotypes"){m.genotypes = resolve(m.dir, val);}
+    else if(key == "phenotypes"){m.phenotypes = resolve(m.dir, val);}
+    else if(key == "covariates"){m.covariates = resolve(m.dir, val);}
+    else if(key == "phi"){m.phi = resolve(m.dir, val);}
+    else if(key == "output"){m.output = resolve(m.dir, val);}
+    else if(key == "traits"){m.traits = parse_indices(val);}
+    else if(key == "shards"){m.shards = std::atoi(val.c_str());}
+    else if(key == "range"){
+      std::string end;
+      if(!(ls >> end)){throw std::runtime_error("manifest: range needs begin and end");}
+      m.ranges.push_back(std::make_pair(std::atol(val.c_str()), std::atol(end.c_str())));
+    }
+    else if(set_run_option(m.run, key, val)){}
+    else if(key == "single"){m.single = std::atoi(val.c_str()) != 0;}
+    else if(key == "sigmabeta"){m.sigmabeta = std::atof(val.c_str());}
+    else if(key == "seed"){m.seed = std::strtoull(val.c_str(), 0, 10);}
+    else {throw std::runtime_error("manifest: unknown key " + key);}
+  }
+  if(m.genotypes.empty() || m.phenotypes.empty() || m.output.empty()){
+    throw std::runtime_error("manifest: genotypes, phenotypes and output are required");
+  }
+  if((m.shards > 0) == !m.ranges.empty()){
+    throw std::runtime_error("manifest: give either shards or range lines");
+  }
+  if(m.output[m.output.size()-1] != '/'){m.output += '/';}
+  return m;
+}
+
+//shard ranges over nsnp SNP columns, checked to be disjoint
+static std::vector<std::pair<long, long> > shard_ranges(const Manifest& m,
+                                                        long nsnp){
+  std::vector<std::pair<long, long> > out = m.ranges;
+  if(m.shards > 0){
+    for (int k=0; k<m.shards; ++k){
+      out.push_back(std::make_pair(nsnp*k/m.shards, nsnp*(k+1)/m.shards));
+    }
+  }
+  std::vector<std::pair<long, long> > sorted = out;
+  std::sort(sorted.begin(), sorted.end());
+  for (size_t k=0; k<sorted.size(); ++k){
+    if(sorted[k].first < 0 || sorted[k].second > nsnp ||
+       sorted[k].first > sorted[k].second){
+      throw std::runtime_error("manifest: shard range outside the SNP columns");
+    }
+    if(k > 0 && sorted[k].first < sorted[k-1].second){
+      throw std::runtime_error("manifest: shard ranges overlap");
+    }
+  }
+  return out;
+}
+
+//the genotype matrix is read a column range at a time, so that no process
+//holds all SNPs: Armadillo binary files by seeking to the range, text (CSV
+//or whitespace separated, optionally with the Armadillo text header) in one
+//pass that keeps only the range. Other formats are loaded whole.
+static bool next_field(const char*& p, double& v){
+  while (*p == ' ' || *p == '\t' || *p == ',' || *p == '\r'){++p;}
+  if(*p == 0){return false;}
+  char* q;
+  v = std::strtod(p, &q);
+  if(q == p){throw std::runtime_error("genotypes: not a number in the text");}
+  p = q;
+  return true;
+}
+
+static arma::mat load_columns(const std::string& path, long begin, long end){
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if(!in){throw std::runtime_error("cannot read matrix " + path);}
+  std::string line;
+  std::getline(in, line);
+  if(line == "ARMA_MAT_BIN_FN008"){
+    long n, nc;
+    if(!(in >> n >> nc)){throw std::runtime_error("cannot read matrix " + path);}
+    in.get();
+    if(begin < 0 || end > nc || begin > end){
+      throw std::runtime_error("genotypes: column range outside the matrix");
+    }
+    arma::mat G(n, end-begin);
+    in.seekg(begin*n*static_cast<long>(sizeof(double)), std::ios::cur);
+    in.read(reinterpret_cast<char*>(G.memptr()), G.n_elem*sizeof(double));
+    if(!in){throw std::runtime_error("cannot read matrix " + path);}
+    return G;
+  }
+  if(line.compare(0, 4, "ARMA") == 0 && line != "ARMA_MAT_TXT_FN008"){
+    arma::mat M = load_matrix(path);
+    if(begin < 0 || end > static_cast<long>(M.n_cols) || begin > end){
+      throw std::runtime_error("genotypes: column range outside the matrix");
+    }
+    return arma::mat(M.head_cols(end).tail_cols(end-begin));
+  }
+  if(line == "ARMA_MAT_TXT_FN008"){
+    std::getline(in, line);  //dimensions
+  }else{
+    in.clear();
+    in.seekg(0);
+  }
+  std::vector<double> vals;
+  long n = 0, nc = -1;
+  while (std::getline(in, line)){
+    const char* p = line.c_str();
+    long col = 0;
+    double v;
+    while (next_field(p, v)){
+      if(col >= begin && col < end){vals.push_back(v);}
+      ++col;
+    }
+    if(col == 0){continue;}
+    if(nc >= 0 && col != nc){
+      throw std::runtime_error("genotypes: rows differ in length");
+    }
+    nc = col;
+    ++n;
+  }
+  if(nc < 0){nc = 0;}
+  if(begin < 0 || end > nc || begin > end){
+    throw std::runtime_error("genotypes: column range outside the matrix");
+  }
+  arma::mat Gt(vals.data(), end-begin, n);
+  return Gt.t();
+}
+
+static long count_snps(const Manifest& m){
+  //the header of a binary file, one line of a text one
+  std::ifstream in(m.genotypes.c_str(), std::ios::binary);
+  if(!in){throw std::runtime_error("cannot read matrix " + m.genotypes);}
+  std::string line;
+  std::getline(in, line);
+  if(line == "ARMA_MAT_BIN_FN008" || line == "ARMA_MAT_TXT_FN008"){
+    long n, nc;
+    if(!(in >> n >> nc)){throw std::runtime_error("cannot read matrix " + m.genotypes);}
+    return nc;
+  }
+  if(line.compare(0, 4, "ARMA") == 0){return load_matrix(m.genotypes).n_cols;}
+  do {
+    const char* p = line.c_str();
+    long col = 0;
+    double v;
+    while (next_field(p, v)){++col;}
+    if(col > 0){return col;}
+  } while (std::getline(in, line));
+  return 0;
+}
+
+static std::string shard_path(const Manifest& m, int k, const char* ext){
+  char name[64];
+  std::snprintf(name, sizeof(name), "shard-%05d.%s", k, ext);
+  return m.output + name;
+}
+
+static size_t record_size(int T){
+  return 8 + 4 + 4 + 8 + 16*static_cast<size_t>(T);
+}
+
+static void write_header(FILE* f, const char* magic, int T, long begin,
+                         long end, uint64_t hash){
+  Header h;
+  std::memcpy(h.magic, magic, 8);
+  h.version = format_version;
+  h.T = T;
+  h.begin = begin;
+  h.end = end;
+  h.hash = hash;
+  if(std::fwrite(&h, sizeof(h), 1, f) != 1){
+    throw std::runtime_error("write failed");
+  }
+}
+
+//true if f starts with this header
+static bool read_header(FILE* f, const char* magic, int T, long begin,
+                        long end, uint64_t hash){
+  Header h;
+  if(std::fread(&h, sizeof(h), 1, f) != 1){return false;}
+  return !std::memcmp(h.magic, magic, 8) && h.version == format_version &&
+    h.T == static_cast<uint32_t>(T) && h.begin == begin && h.end == end &&
+    h.hash == hash;
+}
+
+static void write_record(FILE* f, const SnpResult& r){
+  bool ok = std::fwrite(&r.snp, 8, 1, f) == 1 &&
+    std::fwrite(&r.status, 4, 1, f) == 1 &&
+    std::fwrite(&r.iterations, 4, 1, f) == 1 &&
+    std::fwrite(&r.h, 8, 1, f) == 1 &&
+    std::fwrite(r.pip.memptr(), 8, r.pip.n_elem, f) == r.pip.n_elem &&
+    std::fwrite(r.beta.memptr(), 8, r.beta.n_elem, f) == r.beta.n_elem;
+  if(!ok){throw std::runtime_error("write failed");}
+}
+
+static bool read_record(FILE* f, int T, SnpResult& r){
+  r.pip.set_size(T);
+  r.beta.set_size(T);
+  return std::fread(&r.snp, 8, 1, f) == 1 &&
+    std::fread(&r.status, 4, 1, f) == 1 &&
+    std::fread(&r.iterations, 4, 1, f) == 1 &&
+    std::fread(&r.h, 8, 1, f) == 1 &&
+    std::fread(r.pip.memptr(), 8, T, f) == static_cast<size_t>(T) &&
+    std::fread(r.beta.memptr(), 8, T, f) == static_cast<size_t>(T);
+}
+
+struct ScanData {
+  long first;        //SNP of the first column of G
+  arma::mat G;
+  arma::mat Y;
+  arma::mat Z;
+  arma::mat Phi;
+  arma::mat Sigma0;  //EM start shared by the SNPs, from the first one run;
+                     //unused with factors
+};
+
+//G holds the SNPs [begin, end) only, none for merge
+static ScanData load_data(const Manifest& m, long begin, long end){
+  ScanData d;
+  d.first = begin;
+  if(end > begin){d.G = load_columns(m.genotypes, begin, end);}
+  d.Y = load_matrix(m.phenotypes);
+  if(!m.traits.empty()){
+    arma::uvec cols = arma::conv_to<arma::uvec>::from(m.traits);
+    if(cols.max() >= d.Y.n_cols){
+      throw std::runtime_error("manifest: trait index beyond the columns of Y");
+    }
+    d.Y = arma::mat(d.Y.cols(cols));
+  }
+  if(end > begin && d.G.n_rows != d.Y.n_rows){
+    throw std::runtime_error("genotypes and phenotypes differ in rows");
+  }
+  if(!m.covariates.empty()){d.Z = load_matrix(m.covariates);}
+  int T = d.Y.n_cols;
+  d.Phi = m.phi.empty() ? arma::eye<arma::mat>(T,T) : load_matrix(m.phi);
+  if(d.Phi.n_rows != d.Phi.n_cols || d.Phi.n_rows != d.Y.n_cols){
+    throw std::runtime_error("phi must be T x T");
+  }
+  return d;
+}
+
+static SnpResult empty_result(long snp, int status, int T){
+  SnpResult r;
+  r.snp = snp;
+  r.status = status;
+  r.iterations = 0;
+  r.h = arma::datum::nan;
+  r.pip.set_size(T);
+  r.pip.fill(arma::datum::nan);
+  r.beta = r.pip;
+  return r;
+}
+
+static SnpResult run_snp(const Manifest& m, ScanData& d, long snp){
+  int T = d.Y.n_cols;
+  SnpResult r = empty_result(snp, -1, T);
+  arma::vec X = d.G.col(snp - d.first);
+  mcmc::Data data(X, d.Y, m.single, d.Z);
+  if(m.run.nfactors == 0 && d.Sigma0.is_empty()){
+    d.Sigma0 = mcmc::em_with_zero_mean(data.Y, 100);
+  }
+  mcmc::ChainState state1, state2;
+  mcmc::default_starts(data, m.sigmabeta, state1, state2, d.Sigma0,
+                       m.run.nfactors);
+  mcmc::ChainTrace trace1(T, m.run.niter, m.run.nfactors, m.run.burnin, false);
+  mcmc::ChainTrace trace2(T, m.run.niter, m.run.nfactors, m.run.burnin, false);
+  mcmc::NativeRng rng(splitmix64(m.seed ^ splitmix64(snp)));
+  mcmc::RunResult res = mcmc::run_two_chains(rng, data, d.Phi, m.run, state1,
+                                             state2, trace1, trace2);
+  r.status = res.converged;
+  r.iterations = res.iterations;
+  if(res.converged == mcmc::SCREENED_NULL){
+    r.pip.zeros();
+    return r;
+  }
+  double npost = trace1.npost + trace2.npost;
+  if(npost > 0){
+    arma::vec gs = trace1.gamsum + trace2.gamsum;
+    r.pip = gs/npost;
+    r.beta = (trace1.betasum + trace2.betasum)/gs;
+    int first = std::min(m.run.burnin, res.iterations-1);
+    r.h = 0.5*(arma::mean(trace1.h.subvec(first, res.iterations-1)) +
+               arma::mean(trace2.h.subvec(first, res.iterations-1)));
+  }
+  return r;
+}
+
+static int worker(const Manifest& m, int k){
+  std::vector<std::pair<long, long> > ranges = shard_ranges(m, count_snps(m));
+  if(k < 0 || k >= static_cast<int>(ranges.size())){
+    throw std::runtime_error("no such shard");
+  }
+  long begin = ranges[k].first;
+  long end = ranges[k].second;
+  ScanData d = load_data(m, begin, end);
+  int T = d.Y.n_cols;
+  size_t rec = record_size(T);
+  std::string done_path = shard_path(m, k, "bin");
+  std::string part_path = shard_path(m, k, "part");
+
+  FILE* f = std::fopen(done_path.c_str(), "rb");
+  if(f){
+    bool ok = read_header(f, "MCSHARD1", T, begin, end, m.hash);
+    std::fclose(f);
+    if(!ok){throw std::runtime_error(done_path + " is from another manifest");}
+    std::fprintf(stderr, "shard %d: already done\n", k);
+    return 0;
+  }
+  //resume after the last complete record of an interrupted run
+  long have = 0;
+  f = std::fopen(part_path.c_str(), "r+b");
+  if(f){
+    if(!read_header(f, "MCSHARD1", T, begin, end, m.hash)){
+      std::fclose(f);
+      throw std::runtime_error(part_path + " is from another manifest");
+    }
+    std::fseek(f, 0, SEEK_END);
+    long size = std::ftell(f);
+    have = (size - static_cast<long>(sizeof(Header)))/static_cast<long>(rec);
+    if(have > end-begin){have = end-begin;}
+    long keep = sizeof(Header) + have*rec;
+    std::fflush(f);
+    if(ftruncate(fileno(f), keep) != 0){
+      std::fclose(f);
+      throw std::runtime_error("cannot truncate " + part_path);
+    }
+    std::fseek(f, keep, SEEK_SET);
+    std::fprintf(stderr, "shard %d: resuming after %ld SNPs\n", k, have);
+  }else{
+    mkdir(m.output.c_str(), 0777);
+    f = std::fopen(part_path.c_str(), "wb");
+    if(!f){throw std::runtime_error("cannot write " + part_path);}
+    write_header(f, "MCSHARD1", T, begin, end, m.hash);
+  }
+  for (long s=begin+have; s<end; ++s){
+    SnpResult r;
+    try {
+      r = run_snp(m, d, s);
+    } catch (std::exception& e) {
+      std::fprintf(stderr, "shard %d: SNP %ld failed: %s\n", k, s, e.what());
+      r = empty_result(s, -1, T);
+    }
+    write_record(f, r);
+    std::fflush(f);
+    std::fprintf(stderr, "shard %d: SNP %ld (%ld/%ld) status %d\n", k, s,
+                 s-begin+1, end-begin, r.status);
+  }
+  if(std::fclose(f) != 0){throw std::runtime_error("write failed");}
+  if(std::rename(part_path.c_str(), done_path.c_str()) != 0){
+    throw std::runtime_error("cannot rename " + part_path);
+  }
+  return 0;
+}
+
+static int run_all(const char* self, const char* manifest_path,
+                   const Manifest& m, int jobs){
+  //one worker process per unfinished shard, at most jobs at a time
+  std::vector<std::pair<long, long> > ranges = shard_ranges(m, count_snps(m));
+  std::vector<int> todo;
+  for (size_t k=0; k<ranges.size(); ++k){
+    struct stat st;
+    if(stat(shard_path(m, k, "bin").c_str(), &st) != 0){todo.push_back(k);}
+  }
+  std::map<pid_t, int> running;
+  int failed = 0;
+  size_t next = 0;
+  while (next < todo.size() || !running.empty()){
+    while (next < todo.size() && static_cast<int>(running.size()) < jobs){
+      int k = todo[next++];
+      pid_t pid = fork();
+      if(pid < 0){throw std::runtime_error("fork failed");}
+      if(pid == 0){
+        std::string arg = std::to_string(k);
+        execlp(self, self, "worker", manifest_path, arg.c_str(), (char*)0);
+        std::perror("exec");
+        _exit(127);
+      }
+      running[pid] = k;
+    }
+    int status;
+    pid_t pid = wait(&status);
+    if(pid < 0){
+      if(errno == EINTR){continue;}
+      throw std::runtime_error("wait failed");
+    }
+    int k = running[pid];
+    running.erase(pid);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+      std::fprintf(stderr, "shard %d failed; rerun to resume it\n", k);
+      ++failed;
+    }
+  }
+  return failed ? 1 : 0;
+}
+
+static void write_merged(FILE* out, FILE* tsv, const SnpResult& r){
+  write_record(out, r);
+  std::fprintf(tsv, "%ld\t%d\t%d\t%.6g", static_cast<long>(r.snp), r.status,
+               r.iterations, r.h);
+  for (arma::uword t=0; t<r.pip.n_elem; ++t){std::fprintf(tsv, "\t%.6g", r.pip(t));}
+  for (arma::uword t=0; t<r.beta.n_elem; ++t){std::fprintf(tsv, "\t%.6g", r.beta(t));}
+  std::fprintf(tsv, "\n");
+}
+
+static int merge(const Manifest& m){
+  ScanData d = load_data(m, 0, 0);
+  long nsnp = count_snps(m);
+  int T = d.Y.n_cols;
+  std::vector<std::pair<long, long> > ranges = shard_ranges(m, nsnp);
+  std::vector<std::pair<long, int> > order;
+  for (size_t k=0; k<ranges.size(); ++k){
+    order.push_back(std::make_pair(ranges[k].first, static_cast<int>(k)));
+  }
+  std::sort(order.begin(), order.end());
+  std::string bin_path = m.output + "scan.bin";
+  std::string tsv_path = m.output + "scan.tsv";
+  FILE* out = std::fopen((bin_path + ".tmp").c_str(), "wb");
+  FILE* tsv = std::fopen((tsv_path + ".tmp").c_str(), "w");
+  if(!out || !tsv){throw std::runtime_error("cannot write to " + m.output);}
+  long first = order.empty() ? 0 : ranges[order.front().second].first;
+  long last = order.empty() ? 0 : ranges[order.back().second].second;
+  write_header(out, "MCSCAN01", T, first, last, m.hash);
+  std::fprintf(tsv, "snp\tstatus\titerations\th");
+  for (int t=0; t<T; ++t){std::fprintf(tsv, "\tpip%d", t);}
+  for (int t=0; t<T; ++t){std::fprintf(tsv, "\tbeta%d", t);}
+  std::fprintf(tsv, "\n");
+  int missing = 0;
+  long expect = first;
+  for (size_t o=0; o<order.size(); ++o){
+    int k = order[o].second;
+    long begin = ranges[k].first;
+    long end = ranges[k].second;
+    for (; expect<begin; ++expect){
+      write_merged(out, tsv, empty_result(expect, -2, T));
+    }
+    expect = end;
+    FILE* f = std::fopen(shard_path(m, k, "bin").c_str(), "rb");
+    if(!f){
+      std::fprintf(stderr, "shard %d is not done\n", k);
+      ++missing;
+      continue;
+    }
+    if(!read_header(f, "MCSHARD1", T, begin, end, m.hash)){
+      std::fclose(f);
+      throw std::runtime_error(shard_path(m, k, "bin") + " is from another manifest");
+    }
+    SnpResult r;
+    for (long s=begin; s<end; ++s){
+      if(!read_record(f, T, r) || r.snp != s){
+        std::fclose(f);
+        throw std::runtime_error(shard_path(m, k, "bin") + " is truncated");
+      }
+      write_merged(out, tsv, r);
+    }
+    std::fclose(f);
+  }
+  bool ok = std::fclose(out) == 0;
+  ok = (std::fclose(tsv) == 0) && ok;
+  if(missing > 0){
+    std::remove((bin_path + ".tmp").c_str());
+    std::remove((tsv_path + ".tmp").c_str());
+    std::fprintf(stderr, "%d shards not done; nothing merged\n", missing);
+    return 1;
+  }
+  if(!ok || std::rename((bin_path + ".tmp").c_str(), bin_path.c_str()) != 0 ||
+     std::rename((tsv_path + ".tmp").c_str(), tsv_path.c_str()) != 0){
+    throw std::runtime_error("cannot write to " + m.output);
+  }
+  return 0;
+}
+
+static void usage(){
+  std::fprintf(stderr,
+               "usage: scan worker MANIFEST K\n"
+               "       scan run MANIFEST [--jobs 1]\n"
+               "       scan merge MANIFEST\n");
+}
+
+int main(int argc, char** argv){
+  if(argc < 3){usage(); return 1;}
+  std::string cmd = argv[1];
+  try {
+    Manifest m = read_manifest(argv[2]);
+    if(cmd == "worker" && argc == 4){
+      return worker(m, std::atoi(argv[3]));
+    }
+    if(cmd == "run" && (argc == 3 || (argc == 5 && !std::strcmp(argv[3], "--jobs")))){
+      int jobs = (argc == 5) ? std::atoi(argv[4]) : 1;
+      if(jobs < 1){usage(); return 1;}
+      return run_all(argv[0], argv[2], m, jobs);
+    }
+    if(cmd == "merge" && argc == 3){
+      return merge(m);
+    }
+  } catch (std::exception& e) {
+    std::fprintf(stderr, "scan: %s\n", e.what());
+    return 1;
+  }
+  usage();
+  return 1;
+}